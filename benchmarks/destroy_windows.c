@@ -0,0 +1,81 @@
+/*
+   This file is part of LiTE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+/* wall time of creating and destroying transient windows, destroying a window must not wait for another event */
+
+#include <direct/clock.h>
+#include <lite/lite.h>
+#include <lite/window.h>
+
+#define NUM_WINDOWS 300
+
+int
+main( int argc, char *argv[] )
+{
+     int          i;
+     long long    start, duration;
+     long long    worst = 0;
+     DFBRectangle rect  = { 0, 0, 320, 240 };
+     DFBRectangle popup = { 40, 40, 160, 120 };
+     LiteWindow  *window;
+
+     if (lite_open( &argc, &argv ))
+          return 1;
+
+     if (lite_new_window( NULL, &rect, DWCAPS_NONE, liteNoWindowTheme, "Destroy Windows", &window ))
+          return 1;
+
+     lite_set_window_opacity( window, liteFullWindowOpacity );
+
+     start = direct_clock_get_micros();
+
+     for (i = 0; i < NUM_WINDOWS; i++) {
+          long long   destroy_start;
+          LiteWindow *transient;
+
+          if (lite_new_window( NULL, &popup, DWCAPS_NONE, liteNoWindowTheme, "Transient", &transient ))
+               return 1;
+
+          lite_set_window_opacity( transient, liteFullWindowOpacity );
+
+          /* run the event loop once for the window to be shown */
+          lite_window_event_loop( window, -1 );
+
+          destroy_start = direct_clock_get_micros();
+
+          lite_destroy_window( transient );
+
+          /* run the event loop once for the window to be released */
+          lite_window_event_loop( window, -1 );
+
+          duration = direct_clock_get_micros() - destroy_start;
+          if (worst < duration)
+               worst = duration;
+     }
+
+     duration = direct_clock_get_micros() - start;
+
+     printf( "%d windows created and destroyed in %lld ms, longest destruction %lld us\n", NUM_WINDOWS,
+             duration / 1000, worst );
+
+     lite_destroy_window( window );
+
+     lite_close();
+
+     return 0;
+}
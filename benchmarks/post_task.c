@@ -0,0 +1,166 @@
+/*
+   This file is part of LiTE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+/* throughput of lite_post_task() compared to user events, and latency of tasks posted to an idle event loop */
+
+#include <direct/clock.h>
+#include <direct/thread.h>
+#include <lite/lite.h>
+#include <lite/window.h>
+
+#define NUM_PRODUCERS  4
+#define NUM_MESSAGES   250000
+#define NUM_IDLE_POSTS 20
+
+static LiteWindow *window;
+static int         received;
+static long long   posted_at;
+static long long   worst_latency;
+
+static DFBResult
+count_task( void *data )
+{
+     if (++received == NUM_PRODUCERS * NUM_MESSAGES)
+          lite_exit_event_loop();
+
+     return DFB_OK;
+}
+
+static DFBResult
+count_event( DFBUserEvent *evt,
+             void         *data )
+{
+     return count_task( data );
+}
+
+static DFBResult
+latency_task( void *data )
+{
+     long long latency = direct_clock_get_micros() - posted_at;
+
+     if (worst_latency < latency)
+          worst_latency = latency;
+
+     if (++received == NUM_IDLE_POSTS)
+          lite_exit_event_loop();
+
+     return DFB_OK;
+}
+
+static void *
+post_tasks( DirectThread *thread,
+            void         *arg )
+{
+     int i;
+
+     for (i = 0; i < NUM_MESSAGES; i++)
+          lite_post_task( count_task, NULL );
+
+     return NULL;
+}
+
+static void *
+post_events( DirectThread *thread,
+             void         *arg )
+{
+     int          i;
+     DFBUserEvent event;
+
+     event.clazz = DFEC_USER;
+     event.type  = 0;
+     event.data  = NULL;
+
+     for (i = 0; i < NUM_MESSAGES; i++)
+          lite_post_event_to_window( window, DFB_EVENT(&event) );
+
+     return NULL;
+}
+
+/* post single tasks while the event loop is waiting, a lost wake up leaves a task waiting for the loop timeout */
+static void *
+post_idle_tasks( DirectThread *thread,
+                 void         *arg )
+{
+     int i;
+
+     for (i = 0; i < NUM_IDLE_POSTS; i++) {
+          direct_thread_sleep( 10000 );
+
+          posted_at = direct_clock_get_micros();
+
+          lite_post_task( latency_task, NULL );
+     }
+
+     return NULL;
+}
+
+static void
+run( const char           *name,
+     DirectThreadMainFunc  func,
+     int                   num_threads,
+     int                   num_messages )
+{
+     int           i;
+     long long     start, duration;
+     DirectThread *threads[NUM_PRODUCERS];
+
+     received = 0;
+
+     start = direct_clock_get_micros();
+
+     for (i = 0; i < num_threads; i++)
+          threads[i] = direct_thread_create( DTT_DEFAULT, func, NULL, name );
+
+     lite_window_event_loop( window, 5000 );
+
+     duration = direct_clock_get_micros() - start;
+
+     for (i = 0; i < num_threads; i++) {
+          direct_thread_join( threads[i] );
+          direct_thread_destroy( threads[i] );
+     }
+
+     printf( "%-12s %d/%d messages in %lld ms (%.2f M/s)\n", name, received, num_messages, duration / 1000,
+             received / (double) MAX( duration, 1 ) );
+}
+
+int
+main( int argc, char *argv[] )
+{
+     DFBRectangle rect = { 0, 0, 320, 240 };
+
+     if (lite_open( &argc, &argv ))
+          return 1;
+
+     if (lite_new_window( NULL, &rect, DWCAPS_NONE, liteNoWindowTheme, "Post Task", &window ))
+          return 1;
+
+     lite_on_window_user_event( window, count_event, NULL );
+
+     run( "user events", post_events, NUM_PRODUCERS, NUM_PRODUCERS * NUM_MESSAGES );
+     run( "posted tasks", post_tasks, NUM_PRODUCERS, NUM_PRODUCERS * NUM_MESSAGES );
+     run( "idle tasks", post_idle_tasks, 1, NUM_IDLE_POSTS );
+
+     printf( "worst latency of a task posted to the idle loop: %lld us\n", worst_latency );
+
+     lite_destroy_window( window );
+
+     lite_close();
+
+     return 0;
+}
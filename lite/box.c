@@ -25,7 +25,95 @@ D_DEBUG_DOMAIN( LiteBoxDomain, "LiTE/Box", "LiTE Box" );
 
 /**********************************************************************************************************************/
 
-static void draw_box_and_children( LiteBox *box, const DFBRegion *region, DFBBoolean clear );
+/* grid over the box area, each cell lists the children overlapping it in stacking order */
+typedef struct _LiteBoxIndex {
+     int  valid;
+     int  cols;
+     int  rows;
+     int  cell_w;
+     int  cell_h;
+     int  w;             /* size of the box the grid was built for */
+     int  h;
+     int *cell_start;    /* offsets into entries, cols * rows + 1 */
+     int *entries;       /* child indices */
+     int  num_entries;   /* allocated entries */
+} LiteBoxIndex;
+
+/* offscreen copy of a box and its children */
+typedef struct _LiteBoxCache {
+     IDirectFBSurface   *surface;     /* NULL while the cache is not filled */
+     int                 w;           /* size of the box when the cache was filled */
+     int                 h;
+     int                 x;           /* position in the top level box when the cache was filled */
+     int                 y;
+     unsigned long long  size;        /* bytes used by the surface */
+     unsigned long long  stamp;       /* last use, oldest caches are evicted first */
+     unsigned int        serial;      /* geometry serial when a background snapshot was taken */
+     int                 clears;      /* number of clears since the background snapshot was dropped */
+} LiteBoxCache;
+
+/* while drawing a dirty area, the opaque box it is drawn from, boxes beneath it are skipped */
+static LiteWindow         *dirty_window    = NULL;
+static LiteBox            *dirty_floor     = NULL;
+static bool                floor_reached   = false;
+
+/* number of clears after which the background of a box is kept in a snapshot */
+#define LITE_BOX_BACKGROUND_CLEARS 3
+
+/* boxes with a cache enabled */
+static LiteBox           **cache_boxes     = NULL;
+static int                 num_cache_boxes = 0;
+
+/* boxes with a background snapshot */
+static LiteBox           **background_boxes     = NULL;
+static int                 num_background_boxes = 0;
+
+static unsigned long long  cache_stamp     = 0;
+static LiteBoxCacheStats   cache_stats;
+
+/* changed whenever the geometry or visibility of any box changes, making all geometry caches stale */
+static unsigned int geometry_serial = 1;
+
+/* initial size of a child array */
+#define LITE_BOX_MIN_CHILDREN 4
+
+/* maximum number of opaque children taken into account when drawing a box */
+#define LITE_BOX_MAX_OCCLUDERS 8
+
+/* number of children aimed for in one cell */
+#define LITE_BOX_INDEX_DENSITY 4
+
+/* maximum number of columns or rows */
+#define LITE_BOX_INDEX_MAX_CELLS 64
+
+static DFBResult draw_box             ( LiteBox *box, const DFBRegion *region, DFBBoolean flip );
+static void      draw_box_and_children( LiteBox *box, const DFBRegion *region, DFBBoolean clear );
+
+static bool               box_is_opaque ( const LiteBox *box );
+static bool               occlude_region( DFBRegion *clip, const DFBRegion *area );
+static unsigned long long region_area   ( const DFBRegion *region );
+
+static void geometry_changed( void );
+static bool box_contains    ( const LiteBox *box, const LiteBox *descendant );
+static void skip_draws      ( LiteBox *box );
+static void invalidate_index( LiteBox *box );
+
+static bool surface_changed ( LiteBox *box );
+static void surface_made    ( LiteBox *box );
+static void surface_refresh ( LiteBox *box );
+static void reinit_box      ( LiteBox *box, bool top );
+
+static bool cache_draw      ( LiteBox *box, const DFBRegion *region );
+static void cache_fill      ( LiteBox *box );
+static void cache_release   ( LiteBoxCache *cache );
+static void cache_damage    ( LiteBox *box, DFBRegion *region );
+
+static bool background_restore( LiteBox *box, const DFBRegion *region );
+static void background_fill   ( LiteBox *box );
+static void background_drop   ( LiteBox *box );
+static void background_damage ( LiteBox *box, const DFBRegion *region );
+static void set_window      ( LiteBox *box, LiteWindow *window );
+static void build_index     ( LiteBox *box );
 
 static void defocus_me_or_children( LiteWindow *top, LiteBox *box );
 static void deenter_me_or_children( LiteWindow *top, LiteBox *box );
@@ -58,17 +146,20 @@ lite_init_box( LiteBox *box )
           return ret;
      }
 
-     if (!box->Destroy)
-          box->Destroy = lite_destroy_box;
-
-     lite_add_child( box->parent, box );
-
+     /* set before the box is validated and added, the callbacks of lite_add_child() may already update it */
      box->is_focused         = 0; /* by default all liteboxes are not focused */
      box->is_visible         = 1; /* by default all liteboxes are visible */
      box->is_active          = 1; /* by default all liteboxes receive input events */
      box->catches_all_events = 0; /* by default all liteboxes allow events to be handled by their children */
      box->handle_keys        = 1; /* by default all liteboxes handle keyboard events */
 
+     surface_made( box );
+
+     if (!box->Destroy)
+          box->Destroy = lite_destroy_box;
+
+     lite_add_child( box->parent, box );
+
      if (!box->type)
           box->type = LITE_TYPE_BOX;
 
@@ -80,14 +171,38 @@ lite_draw_box( LiteBox         *box,
                const DFBRegion *region,
                DFBBoolean       flip )
 {
+     DFBResult   ret;
+     LiteWindow *saved_window = dirty_window;
+     LiteBox    *saved_floor  = dirty_floor;
+
      LITE_NULL_PARAMETER_CHECK( box );
 
+     /* draws requested while drawing a dirty area are complete */
+     dirty_window = NULL;
+     dirty_floor  = NULL;
+
+     ret = draw_box( box, region, flip );
+
+     dirty_window = saved_window;
+     dirty_floor  = saved_floor;
+
+     return ret;
+}
+
+static DFBResult
+draw_box( LiteBox         *box,
+          const DFBRegion *region,
+          DFBBoolean       flip )
+{
+
      if (box->is_visible == 0)
           return DFB_OK;
 
      if (box->rect.h == 0 || box->rect.w == 0)
           return DFB_OK;
 
+     surface_refresh( box );
+
      DFBRegion reg = { 0, 0, box->rect.w - 1,  box->rect.h - 1 };
      if (region == NULL) {
           region = &reg;
@@ -102,7 +217,7 @@ lite_draw_box( LiteBox         *box,
           return DFB_OK;
      }
 
-     if (getenv( "LITE_DEBUG_UPDATES" ) && flip) {
+     if (lite_config.debug_updates && flip) {
           if (box->surface->SetClip( box->surface, region ) == DFB_OK) {
                box->surface->Clear   ( box->surface, 0x00, 0x00, 0xff, 0xff );
                box->surface->SetColor( box->surface, 0xff, 0xff, 0xff, 0xff );
@@ -118,7 +233,7 @@ lite_draw_box( LiteBox         *box,
      draw_box_and_children( box, region, DFB_TRUE );
 
      if (flip)
-          box->surface->Flip( box->surface, region, getenv( "LITE_WINDOW_DOUBLEBUFFER" ) ? DSFLIP_BLIT: DSFLIP_NONE );
+          box->surface->Flip( box->surface, region, lite_config.window_doublebuffer ? DSFLIP_BLIT: DSFLIP_NONE );
 
      if (box->type == LITE_TYPE_WINDOW) {
           LiteWindow *window = LITE_WINDOW(box);
@@ -151,7 +266,7 @@ lite_update_box( LiteBox         *box,
      D_DEBUG_AT( LiteBoxDomain, "Update box: %p at %4d,%4d-%4dx%4d\n", box,
                  reg.x1, reg.y1, reg.x2 - reg.x1 + 1, reg.y2 - reg.y1 + 1 );
 
-     if (getenv( "LITE_DEBUG_UPDATES" )) {
+     if (lite_config.debug_updates) {
           if (box->surface->SetClip( box->surface, region ) == DFB_OK) {
                box->surface->Clear   ( box->surface, 0xff, 0x00, 0x00, 0xff );
                box->surface->SetColor( box->surface, 0xff, 0xff, 0xff, 0xff );
@@ -164,29 +279,50 @@ lite_update_box( LiteBox         *box,
           }
      }
 
-     while (1) {
-          if (reg.x2 < reg.x1 || reg.y2 < reg.y1)
-               return DFB_OK;
+     prvlite_box_validate( box );
 
-          if (reg.x1 > box->rect.w - 1 || reg.x2 < 0 || reg.y1 > box->rect.h - 1 || reg.y2 < 0)
-               return DFB_OK;
+     if (!box->cached.visible)
+          return DFB_OK;
 
-          if (box->is_visible == 0)
-               return DFB_OK;
+     /* translate to the top level box and clip to the area left visible by the ancestors */
+     dfb_region_translate( &reg, box->cached.x, box->cached.y );
 
-          if (box->parent) {
-               dfb_region_translate( &reg, box->rect.x, box->rect.y );
-               box = box->parent;
-          }
-          else {
-               if (box->type == LITE_TYPE_WINDOW)
-                    lite_update_window( LITE_WINDOW(box), &reg );
-               else
-                    D_DEBUG_AT( LiteBoxDomain, "  -> can't update a box without a top level parent!\n" );
+     if (reg.x2 < reg.x1 || reg.y2 < reg.y1 || !dfb_region_region_intersect( &reg, &box->cached.clip ))
+          return DFB_OK;
 
-               return DFB_OK;
-          }
+     prvlite_box_damage( box, &reg );
+
+     if (box->cached.root->type == LITE_TYPE_WINDOW)
+          prvlite_update_window( LITE_WINDOW(box->cached.root), &reg, box_is_opaque( box ) ? box : NULL );
+     else
+          D_DEBUG_AT( LiteBoxDomain, "  -> can't update a box without a top level parent!\n" );
+
+     return DFB_OK;
+}
+
+void
+prvlite_box_damage( LiteBox         *box,
+                    const DFBRegion *region )
+{
+     DFBRegion reg;
+
+     if (region == NULL) {
+          reg.x1 = 0;
+          reg.y1 = 0;
+          reg.x2 = box->rect.w - 1;
+          reg.y2 = box->rect.h - 1;
      }
+     else {
+          reg = *region;
+     }
+
+     prvlite_box_validate( box );
+
+     if (num_cache_boxes)
+          cache_damage( box, &reg );
+
+     if (num_background_boxes)
+          background_damage( box, &reg );
 }
 
 DFBResult
@@ -216,8 +352,20 @@ lite_destroy_box( LiteBox *box )
      if (box->children)
           D_FREE( box->children );
 
-     box->children   = NULL;
-     box->n_children = 0;
+     box->children     = NULL;
+     box->n_children   = 0;
+     box->max_children = 0;
+
+     lite_set_box_index( box, 0 );
+
+     lite_set_box_cache( box, 0 );
+
+     background_drop( box );
+
+     if (box->background_cache) {
+          D_FREE( box->background_cache );
+          box->background_cache = NULL;
+     }
 
      if (box->type != LITE_TYPE_WINDOW) {
           D_FREE( box );
@@ -241,28 +389,26 @@ lite_init_box_at( LiteBox            *box,
      box->parent = parent;
      box->rect   = *rect;
 
+     geometry_changed();
+
      return lite_init_box( box );
 }
 
 DFBResult
 lite_reinit_box_and_children( LiteBox *box )
 {
-     DFBResult ret = DFB_OK;
-     int       i;
-
      LITE_NULL_PARAMETER_CHECK( box );
 
      D_DEBUG_AT( LiteBoxDomain, "Give each box a new sub surface\n" );
 
-     /* get new sub surface */
+     geometry_changed();
+
      if (box->parent)
-          ret = box->surface->MakeSubSurface( box->surface, box->parent->surface, &box->rect );
+          invalidate_index( box->parent );
 
-     /* reinit children */
-     for (i = 0; i < box->n_children; i++)
-          ret = lite_reinit_box_and_children( box->children[i] );
+     reinit_box( box, true );
 
-    return ret;
+     return DFB_OK;
 }
 
 DFBResult
@@ -276,6 +422,11 @@ lite_clear_box( LiteBox         *box,
      if (box->parent) {
           DFBRegion reg;
 
+          surface_refresh( box->parent );
+
+          if (background_restore( box, region ))
+               return DFB_OK;
+
           if (region) {
                reg = *region;
                dfb_region_translate( &reg, box->rect.x, box->rect.y );
@@ -291,6 +442,11 @@ lite_clear_box( LiteBox         *box,
                box->parent->Draw( box->parent, &reg, DFB_TRUE );
           else
                lite_clear_box( box->parent, &reg );
+
+          /* keep the background of a box cleared often, once it has been drawn completely */
+          if (!region || (region->x1 <= 0 && region->y1 <= 0 &&
+                          region->x2 >= box->rect.w - 1 && region->y2 >= box->rect.h - 1))
+               background_fill( box );
      }
      else {
           D_DEBUG_AT(LiteBoxDomain, "  -> no parent present\n");
@@ -303,24 +459,66 @@ DFBResult
 lite_add_child( LiteBox *parent,
                 LiteBox *child )
 {
-     LiteWindow *window;
-
      LITE_NULL_PARAMETER_CHECK( parent );
      LITE_NULL_PARAMETER_CHECK( child );
 
      D_DEBUG_AT( LiteBoxDomain, "Add child: %p\n", child );
 
+     return lite_add_children( parent, &child, 1 );
+}
+
+DFBResult
+lite_add_children( LiteBox  *parent,
+                   LiteBox **children,
+                   int       num )
+{
+     LiteWindow *window;
+     int         i;
+
+     LITE_NULL_PARAMETER_CHECK( parent );
+     LITE_NULL_PARAMETER_CHECK( children );
+
+     if (num < 0)
+          return DFB_INVARG;
+
+     for (i = 0; i < num; i++)
+          LITE_NULL_PARAMETER_CHECK( children[i] );
+
+     D_DEBUG_AT( LiteBoxDomain, "Add %d children to box: %p\n", num, parent );
+
+     /* grow the child array geometrically */
+     if (parent->n_children + num > parent->max_children) {
+          int max = MAX( parent->max_children * 2, LITE_BOX_MIN_CHILDREN );
+
+          while (max < parent->n_children + num)
+               max *= 2;
+
+          parent->children     = D_REALLOC( parent->children, sizeof(LiteBox*) * max );
+          parent->max_children = max;
+     }
+
      /* update the child array */
-     parent->n_children++;
-     parent->children = D_REALLOC( parent->children, sizeof(LiteBox*) * parent->n_children );
-     parent->children[parent->n_children-1] = child;
+     memcpy( parent->children + parent->n_children, children, sizeof(LiteBox*) * num );
 
-     /* get a possible window in which the box is included */
+     parent->n_children += num;
+
+     invalidate_index( parent );
+
+     geometry_changed();
+
+     /* get a possible window in which the boxes are included */
      window = lite_find_my_window( parent );
 
+     for (i = 0; i < num; i++)
+          set_window( children[i], window );
+
      if (window != NULL) {
-          if (window->OnBoxAdded)
-               window->OnBoxAdded( window, child );
+          if (window->OnBoxesAdded)
+               window->OnBoxesAdded( window, children, num );
+          else if (window->OnBoxAdded) {
+               for (i = 0; i < num; i++)
+                    window->OnBoxAdded( window, children[i] );
+          }
      }
 
      return DFB_OK;
@@ -369,7 +567,24 @@ lite_remove_child( LiteBox *parent,
      for (; i < parent->n_children; i++)
           parent->children[i] = parent->children[i+1];
 
-     parent->children = D_REALLOC( parent->children, sizeof(LiteBox*) * parent->n_children );
+     /* shrink the child array when it is mostly unused */
+     if (parent->n_children == 0) {
+          D_FREE( parent->children );
+
+          parent->children     = NULL;
+          parent->max_children = 0;
+     }
+     else if (parent->max_children > LITE_BOX_MIN_CHILDREN && parent->n_children < parent->max_children / 4) {
+          parent->max_children /= 2;
+          parent->children      = D_REALLOC( parent->children, sizeof(LiteBox*) * parent->max_children );
+     }
+
+     /* the detached subtree no longer belongs to the window */
+     set_window( child, NULL );
+
+     invalidate_index( parent );
+
+     geometry_changed();
 
      return DFB_OK;
 }
@@ -388,6 +603,8 @@ lite_set_box_visible( LiteBox *box,
      if (visible) {
           box->is_visible = 1;
 
+          geometry_changed();
+
           return lite_update_box( box, NULL );
      }
 
@@ -395,6 +612,86 @@ lite_set_box_visible( LiteBox *box,
 
      box->is_visible = 0;
 
+     geometry_changed();
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_set_box_index( LiteBox *box,
+                    int      enable )
+{
+     LITE_NULL_PARAMETER_CHECK( box );
+
+     D_DEBUG_AT( LiteBoxDomain, "%s spatial index of box: %p\n", enable ? "Enable" : "Disable", box );
+
+     if (enable) {
+          if (!box->index)
+               box->index = D_CALLOC( 1, sizeof(LiteBoxIndex) );
+     }
+     else if (box->index) {
+          if (box->index->cell_start)
+               D_FREE( box->index->cell_start );
+
+          if (box->index->entries)
+               D_FREE( box->index->entries );
+
+          D_FREE( box->index );
+
+          box->index = NULL;
+     }
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_set_box_cache( LiteBox *box,
+                    int      enable )
+{
+     int i;
+
+     LITE_NULL_PARAMETER_CHECK( box );
+
+     D_DEBUG_AT( LiteBoxDomain, "%s cache of box: %p\n", enable ? "Enable" : "Disable", box );
+
+     if (enable) {
+          if (!box->cache) {
+               box->cache = D_CALLOC( 1, sizeof(LiteBoxCache) );
+
+               cache_boxes = D_REALLOC( cache_boxes, sizeof(LiteBox*) * (num_cache_boxes + 1) );
+               cache_boxes[num_cache_boxes++] = box;
+          }
+     }
+     else if (box->cache) {
+          cache_release( box->cache );
+
+          for (i = 0; i < num_cache_boxes; i++) {
+               if (cache_boxes[i] == box) {
+                    cache_boxes[i] = cache_boxes[--num_cache_boxes];
+                    break;
+               }
+          }
+
+          if (!num_cache_boxes) {
+               D_FREE( cache_boxes );
+               cache_boxes = NULL;
+          }
+
+          D_FREE( box->cache );
+
+          box->cache = NULL;
+     }
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_get_box_cache_stats( LiteBoxCacheStats *ret_stats )
+{
+     LITE_NULL_PARAMETER_CHECK( ret_stats );
+
+     *ret_stats = cache_stats;
+
      return DFB_OK;
 }
 
@@ -428,12 +725,352 @@ lite_focus_box( LiteBox *box )
 
 /* internals */
 
+void
+prvlite_box_validate( LiteBox *box )
+{
+     LiteBox *parent = box->parent;
+
+     if (box->cached.serial == geometry_serial)
+          return;
+
+     if (parent) {
+          prvlite_box_validate( parent );
+
+          box->cached.x       = parent->cached.x + box->rect.x;
+          box->cached.y       = parent->cached.y + box->rect.y;
+          box->cached.clip    = parent->cached.clip;
+          box->cached.visible = parent->cached.visible && box->is_visible;
+          box->cached.root    = parent->cached.root;
+
+          if (!dfb_region_intersect( &box->cached.clip, box->cached.x, box->cached.y,
+                                     box->cached.x + box->rect.w - 1, box->cached.y + box->rect.h - 1 ))
+               box->cached.visible = 0;
+     }
+     else {
+          box->cached.x       = 0;
+          box->cached.y       = 0;
+          box->cached.visible = box->is_visible && box->rect.w > 0 && box->rect.h > 0;
+          box->cached.root    = box;
+
+          box->cached.clip.x1 = 0;
+          box->cached.clip.y1 = 0;
+          box->cached.clip.x2 = box->rect.w - 1;
+          box->cached.clip.y2 = box->rect.h - 1;
+     }
+
+     box->cached.serial = geometry_serial;
+}
+
+void
+prvlite_draw_dirty_area( LiteWindow      *window,
+                         const DFBRegion *region,
+                         LiteBox         *floor )
+{
+     LiteWindow *saved_window  = dirty_window;
+     LiteBox    *saved_floor   = dirty_floor;
+     bool        saved_reached = floor_reached;
+
+     dirty_window  = window;
+     dirty_floor   = floor;
+     floor_reached = false;
+
+     draw_box( LITE_BOX(window), region, DFB_TRUE );
+
+     dirty_window  = saved_window;
+     dirty_floor   = saved_floor;
+     floor_reached = saved_reached;
+}
+
+unsigned int
+prvlite_box_geometry_serial()
+{
+     return geometry_serial;
+}
+
+static bool
+box_contains( const LiteBox *box,
+              const LiteBox *descendant )
+{
+     while (descendant) {
+          if (descendant == box)
+               return true;
+
+          descendant = descendant->parent;
+     }
+
+     return false;
+}
+
+/* count the Draw() callbacks of a subtree left out */
+static void
+skip_draws( LiteBox *box )
+{
+     int i;
+
+     if (!box->is_visible)
+          return;
+
+     if (box->Draw && dirty_window)
+          dirty_window->updates.stats.skipped_draws++;
+
+     for (i = 0; i < box->n_children; i++)
+          skip_draws( box->children[i] );
+}
+
+/* check whether the sub surface no longer matches the area of the box */
+static bool
+surface_changed( LiteBox *box )
+{
+     const DFBRegion *clip = &box->cached.clip;
+
+     prvlite_box_validate( box );
+
+     return box->sub.clipped || box->sub.x != box->cached.x || box->sub.y != box->cached.y ||
+            box->sub.w != box->rect.w || box->sub.h != box->rect.h ||
+            clip->x1 != box->cached.x || clip->y1 != box->cached.y ||
+            clip->x2 != box->cached.x + box->rect.w - 1 || clip->y2 != box->cached.y + box->rect.h - 1;
+}
+
+static void
+surface_made( LiteBox *box )
+{
+     const DFBRegion *clip = &box->cached.clip;
+
+     prvlite_box_validate( box );
+
+     box->sub.x       = box->cached.x;
+     box->sub.y       = box->cached.y;
+     box->sub.w       = box->rect.w;
+     box->sub.h       = box->rect.h;
+     box->sub.clipped = clip->x1 != box->cached.x || clip->y1 != box->cached.y ||
+                        clip->x2 != box->cached.x + box->rect.w - 1 || clip->y2 != box->cached.y + box->rect.h - 1;
+     box->sub.stale   = 0;
+}
+
+static void
+surface_refresh( LiteBox *box )
+{
+     DFBResult ret;
+
+     if (!box->sub.stale)
+          return;
+
+     /* the parent's sub surface must be up to date first */
+     surface_refresh( box->parent );
+
+     D_DEBUG_AT( LiteBoxDomain, "  -> making new sub surface for box %p\n", box );
+
+     ret = box->surface->MakeSubSurface( box->surface, box->parent->surface, &box->rect );
+     if (ret)
+          DirectFBError( "LiTE/Box: MakeSubSurface() failed", ret );
+
+     surface_made( box );
+}
+
+static void
+reinit_box( LiteBox *box,
+            bool     top )
+{
+     int i;
+
+     if (box->parent) {
+          box->sub.stale = surface_changed( box );
+
+          /* neither the box nor its children moved */
+          if (!box->sub.stale && box->is_fixed && !top)
+               return;
+     }
+
+     invalidate_index( box );
+
+     for (i = 0; i < box->n_children; i++)
+          reinit_box( box->children[i], false );
+}
+
+static void
+geometry_changed()
+{
+     /* zero marks a box that has never been validated */
+     if (!++geometry_serial)
+          geometry_serial = 1;
+}
+
+LiteBox *
+prvlite_box_child_at( LiteBox *box,
+                      int      x,
+                      int      y )
+{
+     LiteBoxIndex *index = box->index;
+     int           i;
+
+     /* the box may have been resized without reinitializing it */
+     if (index && (!index->valid || index->w != box->rect.w || index->h != box->rect.h))
+          build_index( box );
+
+     /* points outside of the grid are looked up by scanning all children */
+     if (index && x >= 0 && y >= 0 && x < index->w && y < index->h) {
+          int col  = MIN( x / index->cell_w, index->cols - 1 );
+          int row  = MIN( y / index->cell_h, index->rows - 1 );
+          int cell = row * index->cols + col;
+
+          for (i = index->cell_start[cell+1] - 1; i >= index->cell_start[cell]; i--) {
+               LiteBox *child = box->children[index->entries[i]];
+
+               if (child->is_visible && DFB_RECTANGLE_CONTAINS_POINT( &child->rect, x, y ))
+                    return child;
+          }
+
+          return NULL;
+     }
+
+     for (i = box->n_children - 1; i >= 0; i--) {
+          LiteBox *child = box->children[i];
+
+          if (child->is_visible && DFB_RECTANGLE_CONTAINS_POINT( &child->rect, x, y ))
+               return child;
+     }
+
+     return NULL;
+}
+
+/* the window of a box is inherited by its whole subtree */
+static void
+set_window( LiteBox    *box,
+            LiteWindow *window )
+{
+     int i;
+
+     if (box->window == window)
+          return;
+
+     box->window = window;
+
+     for (i = 0; i < box->n_children; i++)
+          set_window( box->children[i], window );
+}
+
+static void
+invalidate_index( LiteBox *box )
+{
+     if (box->index)
+          box->index->valid = 0;
+}
+
+/* cells covered by a child, returns false if the child lies outside of the grid */
+static bool
+index_child_cells( const LiteBoxIndex *index,
+                   const LiteBox      *box,
+                   const LiteBox      *child,
+                   DFBRegion          *ret_cells )
+{
+     DFBRegion area = { 0, 0, box->rect.w - 1, box->rect.h - 1 };
+
+     if (child->rect.w <= 0 || child->rect.h <= 0)
+          return false;
+
+     if (!dfb_region_intersect( &area, child->rect.x, child->rect.y,
+                                child->rect.x + child->rect.w - 1, child->rect.y + child->rect.h - 1 ))
+          return false;
+
+     ret_cells->x1 = area.x1 / index->cell_w;
+     ret_cells->y1 = area.y1 / index->cell_h;
+     ret_cells->x2 = area.x2 / index->cell_w;
+     ret_cells->y2 = area.y2 / index->cell_h;
+
+     return true;
+}
+
+static void
+build_index( LiteBox *box )
+{
+     LiteBoxIndex *index = box->index;
+     DFBRegion     cells;
+     int           i, x, y, n;
+     int           num_cells;
+     int           num_entries = 0;
+
+     D_DEBUG_AT( LiteBoxDomain, "Build spatial index of box: %p (%d children)\n", box, box->n_children );
+
+     /* aim for a few children per cell, keeping cells roughly square */
+     num_cells = MAX( box->n_children / LITE_BOX_INDEX_DENSITY, 1 );
+
+     index->cols = 1;
+     while (index->cols < LITE_BOX_INDEX_MAX_CELLS &&
+            (long long) index->cols * index->cols * MAX( box->rect.h, 1 ) < (long long) num_cells * box->rect.w)
+          index->cols++;
+
+     index->rows = MAX( MIN( num_cells / index->cols, LITE_BOX_INDEX_MAX_CELLS ), 1 );
+
+     index->cell_w = MAX( (box->rect.w + index->cols - 1) / index->cols, 1 );
+     index->cell_h = MAX( (box->rect.h + index->rows - 1) / index->rows, 1 );
+
+     index->w = box->rect.w;
+     index->h = box->rect.h;
+
+     num_cells = index->cols * index->rows;
+
+     if (index->cell_start)
+          D_FREE( index->cell_start );
+
+     index->cell_start = D_CALLOC( num_cells + 1, sizeof(int) );
+
+     /* count the children of each cell */
+     for (i = 0; i < box->n_children; i++) {
+          if (!index_child_cells( index, box, box->children[i], &cells ))
+               continue;
+
+          for (y = cells.y1; y <= cells.y2; y++) {
+               for (x = cells.x1; x <= cells.x2; x++)
+                    index->cell_start[y*index->cols+x+1]++;
+          }
+
+          num_entries += (cells.x2 - cells.x1 + 1) * (cells.y2 - cells.y1 + 1);
+     }
+
+     for (n = 0; n < num_cells; n++)
+          index->cell_start[n+1] += index->cell_start[n];
+
+     if (index->num_entries < num_entries) {
+          index->entries     = D_REALLOC( index->entries, num_entries * sizeof(int) );
+          index->num_entries = num_entries;
+     }
+
+     /* fill in the children in stacking order, using the cell starts as cursors */
+     for (i = 0; i < box->n_children; i++) {
+          if (!index_child_cells( index, box, box->children[i], &cells ))
+               continue;
+
+          for (y = cells.y1; y <= cells.y2; y++) {
+               for (x = cells.x1; x <= cells.x2; x++)
+                    index->entries[index->cell_start[y*index->cols+x]++] = i;
+          }
+     }
+
+     /* the cursors ended at the start of the next cell, shift them back */
+     for (n = num_cells; n > 0; n--)
+          index->cell_start[n] = index->cell_start[n-1];
+
+     index->cell_start[0] = 0;
+
+     index->valid = 1;
+}
+
 static void
 draw_box_and_children( LiteBox         *box,
                        const DFBRegion *region,
                        DFBBoolean       clear )
 {
-     int i;
+     int        i, n;
+     DFBRegion  clip;
+     DFBRegion  full;
+     bool       beneath       = false;
+     bool       covered       = false;
+     int        first         = 0;
+     int        num_occluders = 0;
+     struct {
+          int       index;
+          DFBRegion clip;
+     }          occluders[LITE_BOX_MAX_OCCLUDERS]; /* clip left beneath each child that hides a part of the region */
 
      D_ASSERT( box != NULL );
 
@@ -449,27 +1086,477 @@ draw_box_and_children( LiteBox         *box,
      D_DEBUG_AT( LiteBoxDomain, "Draw box:   %p at %4d,%4d-%4dx%4d\n", box,
                  box->rect.x, box->rect.y, box->rect.w, box->rect.h );
 
-     box->surface->SetClip( box->surface, region );
+     clip.x1 = MAX( region->x1, 0 );
+     clip.y1 = MAX( region->y1, 0 );
+     clip.x2 = MIN( region->x2, box->rect.w - 1 );
+     clip.y2 = MIN( region->y2, box->rect.h - 1 );
 
-     if (box->background)
-          box->surface->Clear( box->surface,
-                               box->background->r, box->background->g, box->background->b, box->background->a );
+     full = clip;
 
-     /* draw box */
-     if (box->Draw)
-          box->Draw( box, region, clear );
+     surface_refresh( box );
 
-     /* draw children */
-     for (i = 0; i < box->n_children; i++) {
-          DFBRegion  reg   = *region;
+     /* drawing a dirty area, nothing beneath its opaque box needs to be drawn */
+     if (dirty_floor && !floor_reached) {
+          if (box == dirty_floor)
+               floor_reached = true;
+          else if (!box_contains( box, dirty_floor )) {
+               skip_draws( box );
+               return;
+          }
+          else
+               beneath = true;
+     }
+
+     if (box->cache && !beneath && cache_draw( box, &full ))
+          return;
+
+     /* walk down from the topmost child, removing the area of opaque children from what lies beneath */
+     for (i = box->n_children - 1; i >= 0 && num_occluders < LITE_BOX_MAX_OCCLUDERS; i--) {
+          LiteBox   *child = box->children[i];
+          DFBRegion  area;
+          DFBRegion  old   = clip;
+
+          if (!child->is_visible || !box_is_opaque( child ) || child->rect.w <= 0 || child->rect.h <= 0)
+               continue;
+
+          dfb_region_from_rectangle( &area, &child->rect );
+
+          if (!occlude_region( &clip, &area )) {
+               covered = true;
+               first   = i;
+               break;
+          }
+
+          if (old.x1 != clip.x1 || old.y1 != clip.y1 || old.x2 != clip.x2 || old.y2 != clip.y2) {
+               occluders[num_occluders].index = i;
+               occluders[num_occluders].clip  = clip;
+               num_occluders++;
+          }
+     }
+
+     if (covered || num_occluders) {
+          D_DEBUG_AT( LiteBoxDomain, "  -> %s, %d children hidden\n",
+                      covered ? "covered by opaque children" : "partly covered by opaque children", first );
+
+          if (box->window) {
+               if (box->Draw || box->background)
+                    box->window->updates.stats.culled_pixels += covered ? region_area( &full ) :
+                                                                region_area( &full ) - region_area( &clip );
+
+               box->window->updates.stats.culled_boxes += first + (covered ? 1 : 0);
+          }
+     }
+
+     if (beneath) {
+          if (box->Draw && dirty_window)
+               dirty_window->updates.stats.skipped_draws++;
+     }
+     else if (!covered) {
+          box->surface->SetClip( box->surface, &clip );
+
+          if (box->background)
+               box->surface->Clear( box->surface,
+                                    box->background->r, box->background->g, box->background->b, box->background->a );
+
+          /* draw box */
+          if (box->Draw)
+               box->Draw( box, &clip, clear );
+     }
+
+     /* draw children, each one clipped by the opaque children above it */
+     for (i = first, n = num_occluders - 1; i < box->n_children; i++) {
+          DFBRegion  reg;
           LiteBox   *child = box->children[i];
 
+          while (n >= 0 && occluders[n].index <= i)
+               n--;
+
+          reg = n >= 0 ? occluders[n].clip : full;
+
           dfb_region_translate( &reg, -child->rect.x, -child->rect.y );
           draw_box_and_children( child, &reg, DFB_FALSE );
      }
 
-     if (box->DrawAfter)
-          box->DrawAfter( box, region );
+     if (box->DrawAfter && (!dirty_floor || floor_reached)) {
+          box->surface->SetClip( box->surface, &full );
+
+          box->DrawAfter( box, &full );
+     }
+
+     /* keep the result once the whole box has been drawn */
+     if (box->cache && !box->cache->surface &&
+         full.x1 == 0 && full.y1 == 0 && full.x2 == box->rect.w - 1 && full.y2 == box->rect.h - 1)
+          cache_fill( box );
+}
+
+/* blit a cached box, returns false if the cache can't be used */
+static bool
+cache_draw( LiteBox         *box,
+            const DFBRegion *region )
+{
+     LiteBoxCache *cache = box->cache;
+     DFBRectangle  rect;
+
+     if (cache->surface) {
+          prvlite_box_validate( box );
+
+          /* a box that is not opaque also holds what was beneath it */
+          if (cache->w != box->rect.w || cache->h != box->rect.h ||
+              (!box_is_opaque( box ) && (cache->x != box->cached.x || cache->y != box->cached.y))) {
+               D_DEBUG_AT( LiteBoxDomain, "  -> cache of box %p invalidated by geometry change\n", box );
+
+               cache_release( cache );
+
+               cache_stats.invalidations++;
+          }
+     }
+
+     if (!cache->surface) {
+          cache_stats.misses++;
+          return false;
+     }
+
+     cache_stats.hits++;
+
+     cache->stamp = ++cache_stamp;
+
+     D_DEBUG_AT( LiteBoxDomain, "  -> drawn from cache\n" );
+
+     rect.x = region->x1;
+     rect.y = region->y1;
+     rect.w = region->x2 - region->x1 + 1;
+     rect.h = region->y2 - region->y1 + 1;
+
+     box->surface->SetClip( box->surface, region );
+     box->surface->SetBlittingFlags( box->surface, DSBLIT_NOFX );
+     box->surface->Blit( box->surface, cache->surface, &rect, rect.x, rect.y );
+
+     return true;
+}
+
+/* copy a completely drawn box into its cache, evicting other caches if needed */
+static void
+cache_fill( LiteBox *box )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  dsc;
+     DFBSurfacePixelFormat  format;
+     LiteBoxCache          *cache = box->cache;
+     unsigned long long     limit     = lite_config.cache_memory * 1024ULL;
+     unsigned long long     evictable = 0;
+     unsigned long long     size;
+     int                    i;
+
+     box->surface->GetPixelFormat( box->surface, &format );
+
+     size = (unsigned long long) box->rect.w * box->rect.h * DFB_BYTES_PER_PIXEL( format );
+
+     /* background snapshots are not evicted, don't evict box caches if that would not make enough room anyway */
+     for (i = 0; i < num_cache_boxes; i++) {
+          if (cache_boxes[i]->cache->surface)
+               evictable += cache_boxes[i]->cache->size;
+     }
+
+     if (cache_stats.memory - evictable + size > limit)
+          return;
+
+     while (cache_stats.memory + size > limit) {
+          LiteBox *oldest = NULL;
+
+          for (i = 0; i < num_cache_boxes; i++) {
+               if (cache_boxes[i]->cache->surface &&
+                   (!oldest || cache_boxes[i]->cache->stamp < oldest->cache->stamp))
+                    oldest = cache_boxes[i];
+          }
+
+          if (!oldest)
+               return;
+
+          D_DEBUG_AT( LiteBoxDomain, "  -> evicting cache of box %p\n", oldest );
+
+          cache_release( oldest->cache );
+
+          cache_stats.evictions++;
+     }
+
+     dsc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     dsc.width       = box->rect.w;
+     dsc.height      = box->rect.h;
+     dsc.pixelformat = format;
+
+     ret = lite_dfb->CreateSurface( lite_dfb, &dsc, &cache->surface );
+     if (ret) {
+          DirectFBError( "LiTE/Box: CreateSurface() failed", ret );
+          cache->surface = NULL;
+          return;
+     }
+
+     cache->surface->Blit( cache->surface, box->surface, NULL, 0, 0 );
+
+     prvlite_box_validate( box );
+
+     cache->w     = box->rect.w;
+     cache->h     = box->rect.h;
+     cache->x     = box->cached.x;
+     cache->y     = box->cached.y;
+     cache->size  = size;
+     cache->stamp = ++cache_stamp;
+
+     cache_stats.memory += size;
+
+     D_DEBUG_AT( LiteBoxDomain, "  -> cache of box %p filled (%llu bytes)\n", box, size );
+}
+
+static void
+cache_release( LiteBoxCache *cache )
+{
+     if (!cache->surface)
+          return;
+
+     cache->surface->Release( cache->surface );
+     cache->surface = NULL;
+
+     cache_stats.memory -= cache->size;
+}
+
+/* restore the background of a box from its snapshot, returns false if there is none */
+static bool
+background_restore( LiteBox         *box,
+                    const DFBRegion *region )
+{
+     LiteBoxCache *cache = box->background_cache;
+     DFBRegion     reg   = { 0, 0, box->rect.w - 1, box->rect.h - 1 };
+     DFBRectangle  rect;
+
+     if (!cache)
+          box->background_cache = cache = D_CALLOC( 1, sizeof(LiteBoxCache) );
+
+     /* the snapshot holds what the ancestors drew for the current geometry */
+     if (cache->surface && (cache->serial != geometry_serial || cache->w != box->rect.w || cache->h != box->rect.h))
+          background_drop( box );
+
+     if (!cache->surface) {
+          cache->clears++;
+          return false;
+     }
+
+     if (region && !dfb_region_region_intersect( &reg, region ))
+          return true;
+
+     cache_stats.background_hits++;
+
+     D_DEBUG_AT( LiteBoxDomain, "  -> background restored from snapshot\n" );
+
+     rect.x = reg.x1;
+     rect.y = reg.y1;
+     rect.w = reg.x2 - reg.x1 + 1;
+     rect.h = reg.y2 - reg.y1 + 1;
+
+     dfb_region_translate( &reg, box->rect.x, box->rect.y );
+
+     box->parent->surface->SetClip( box->parent->surface, &reg );
+     box->parent->surface->SetBlittingFlags( box->parent->surface, DSBLIT_NOFX );
+     box->parent->surface->Blit( box->parent->surface, cache->surface, &rect, reg.x1, reg.y1 );
+
+     return true;
+}
+
+/* take a snapshot of the background that has just been drawn beneath a box */
+static void
+background_fill( LiteBox *box )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  dsc;
+     DFBSurfacePixelFormat  format;
+     LiteBoxCache          *cache = box->background_cache;
+     unsigned long long     size;
+
+     if (cache->surface || cache->clears < LITE_BOX_BACKGROUND_CLEARS)
+          return;
+
+     box->surface->GetPixelFormat( box->surface, &format );
+
+     size = (unsigned long long) box->rect.w * box->rect.h * DFB_BYTES_PER_PIXEL( format );
+
+     /* snapshots don't evict other caches */
+     if (cache_stats.memory + size > lite_config.cache_memory * 1024ULL)
+          return;
+
+     dsc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     dsc.width       = box->rect.w;
+     dsc.height      = box->rect.h;
+     dsc.pixelformat = format;
+
+     ret = lite_dfb->CreateSurface( lite_dfb, &dsc, &cache->surface );
+     if (ret) {
+          DirectFBError( "LiTE/Box: CreateSurface() failed", ret );
+          cache->surface = NULL;
+          return;
+     }
+
+     cache->surface->Blit( cache->surface, box->surface, NULL, 0, 0 );
+
+     cache->w      = box->rect.w;
+     cache->h      = box->rect.h;
+     cache->size   = size;
+     cache->serial = geometry_serial;
+
+     cache_stats.memory += size;
+     cache_stats.background_fills++;
+
+     background_boxes = D_REALLOC( background_boxes, sizeof(LiteBox*) * (num_background_boxes + 1) );
+     background_boxes[num_background_boxes++] = box;
+
+     D_DEBUG_AT( LiteBoxDomain, "  -> background snapshot of box %p taken (%llu bytes)\n", box, size );
+}
+
+/* drop the background snapshot of a box, clears are counted again before the next one */
+static void
+background_drop( LiteBox *box )
+{
+     int i;
+
+     if (!box->background_cache)
+          return;
+
+     if (box->background_cache->surface) {
+          cache_release( box->background_cache );
+
+          for (i = 0; i < num_background_boxes; i++) {
+               if (background_boxes[i] == box) {
+                    background_boxes[i] = background_boxes[--num_background_boxes];
+                    break;
+               }
+          }
+
+          if (!num_background_boxes) {
+               D_FREE( background_boxes );
+               background_boxes = NULL;
+          }
+     }
+
+     box->background_cache->clears = 0;
+}
+
+/* drop the background snapshots beneath an updated box, given in top level coordinates */
+static void
+background_damage( LiteBox         *box,
+                   const DFBRegion *region )
+{
+     int i;
+
+     for (i = 0; i < num_background_boxes; i++) {
+          LiteBox *snapshot = background_boxes[i];
+          LiteBox *traverse;
+
+          prvlite_box_validate( snapshot );
+
+          if (snapshot->cached.root != box->cached.root ||
+              !dfb_region_region_intersects( region, &snapshot->cached.clip ))
+               continue;
+
+          /* only the ancestors draw the background */
+          for (traverse = snapshot->parent; traverse; traverse = traverse->parent) {
+               if (traverse == box) {
+                    D_DEBUG_AT( LiteBoxDomain, "  -> background snapshot of box %p dropped by update\n", snapshot );
+
+                    background_drop( snapshot );
+
+                    cache_stats.background_drops++;
+
+                    /* the last snapshot has been moved into this slot */
+                    i--;
+                    break;
+               }
+          }
+     }
+}
+
+/* drop the caches affected by an update of a box, given in top level coordinates */
+static void
+cache_damage( LiteBox   *box,
+              DFBRegion *region )
+{
+     int i;
+
+     for (i = 0; i < num_cache_boxes; i++) {
+          LiteBox  *cached = cache_boxes[i];
+          LiteBox  *traverse;
+          bool      inside = false;
+
+          if (!cached->cache->surface)
+               continue;
+
+          prvlite_box_validate( cached );
+
+          if (cached->cached.root != box->cached.root ||
+              !dfb_region_region_intersects( region, &cached->cached.clip ))
+               continue;
+
+          for (traverse = box; traverse; traverse = traverse->parent) {
+               if (traverse == cached) {
+                    inside = true;
+                    break;
+               }
+          }
+
+          /* the pixels of an opaque box don't depend on what is updated beneath or above it */
+          if (!inside && box_is_opaque( cached ))
+               continue;
+
+          D_DEBUG_AT( LiteBoxDomain, "  -> cache of box %p invalidated by update\n", cached );
+
+          cache_release( cached->cache );
+
+          cache_stats.invalidations++;
+
+          /* redraw the whole box so that the cache gets filled again */
+          if (inside) {
+               region->x1 = MIN( region->x1, cached->cached.clip.x1 );
+               region->y1 = MIN( region->y1, cached->cached.clip.y1 );
+               region->x2 = MAX( region->x2, cached->cached.clip.x2 );
+               region->y2 = MAX( region->y2, cached->cached.clip.y2 );
+          }
+     }
+}
+
+static bool
+box_is_opaque( const LiteBox *box )
+{
+     return box->is_opaque || (box->background && box->background->a == 0xff);
+}
+
+/* remove an opaque area from a clip as long as the rest is a rectangle, returns false if nothing is left */
+static bool
+occlude_region( DFBRegion       *clip,
+                const DFBRegion *area )
+{
+     if (area->x2 < clip->x1 || area->x1 > clip->x2 || area->y2 < clip->y1 || area->y1 > clip->y2)
+          return true;
+
+     if (area->x1 <= clip->x1 && area->x2 >= clip->x2) {
+          if (area->y1 <= clip->y1 && area->y2 >= clip->y2)
+               return false;
+
+          if (area->y1 <= clip->y1)
+               clip->y1 = area->y2 + 1;
+          else if (area->y2 >= clip->y2)
+               clip->y2 = area->y1 - 1;
+     }
+     else if (area->y1 <= clip->y1 && area->y2 >= clip->y2) {
+          if (area->x1 <= clip->x1)
+               clip->x1 = area->x2 + 1;
+          else if (area->x2 >= clip->x2)
+               clip->x2 = area->x1 - 1;
+     }
+
+     return true;
+}
+
+static unsigned long long
+region_area( const DFBRegion *region )
+{
+     return (unsigned long long) (region->x2 - region->x1 + 1) * (region->y2 - region->y1 + 1);
 }
 
 static void
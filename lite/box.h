@@ -60,25 +60,64 @@ typedef enum {
      LITE_TYPE_LIST        = 0x800B,        /**< LiteList type */
 } LiteBoxType;
 
+/**
+ * @brief Box cache statistics.
+ */
+typedef struct {
+     unsigned int        hits;              /**< Draws served by blitting a cache */
+     unsigned int        misses;            /**< Draws of a cached box without a valid cache */
+     unsigned int        invalidations;     /**< Caches dropped because of damage or geometry changes */
+     unsigned int        evictions;         /**< Caches dropped to stay within the memory limit */
+     unsigned long long  memory;            /**< Memory used by cache and background surfaces (bytes) */
+     unsigned int        background_hits;   /**< Backgrounds restored from a snapshot by lite_clear_box() */
+     unsigned int        background_fills;  /**< Background snapshots taken */
+     unsigned int        background_drops;  /**< Background snapshots dropped because of ancestor damage */
+} LiteBoxCacheStats;
+
 /**
  * @brief LiteBox structure.
  */
 typedef struct _LiteBox {
-     struct _LiteBox   *parent;             /**< Parent of the LiteBox */
-
-     int                n_children;         /**< Number of children in child array */
-     struct _LiteBox  **children;           /**< Child array */
-
-     LiteBoxType        type;               /**< LiteBox type */
-     DFBRectangle       rect;               /**< Rectangle of the LiteBox */
-     IDirectFBSurface  *surface;            /**< LiteBox surface */
-     DFBColor          *background;         /**< Background color */
-     void              *user_data;          /**< User data */
-     int                is_focused;         /**< LiteBox is focused or not */
-     int                is_visible;         /**< LiteBox is visible or not */
-     int                is_active;          /**< LiteBox receives input events or not */
-     int                catches_all_events; /**< LiteBox prevents events from being handled by its children or not */
-     int                handle_keys;        /**< LiteBox handles keyboard events or not */
+     struct _LiteBox      *parent;             /**< Parent of the LiteBox */
+
+     int                   n_children;         /**< Number of children in child array */
+     int                   max_children;       /**< Allocated size of the child array */
+     struct _LiteBox     **children;           /**< Child array */
+     struct _LiteWindow   *window;             /**< Window the LiteBox belongs to, NULL if not yet known */
+     struct _LiteBoxIndex *index;              /**< Spatial index of the children, NULL if not enabled */
+     struct _LiteBoxCache *cache;              /**< Offscreen copy of the LiteBox and its children, NULL if disabled */
+     struct _LiteBoxCache *background_cache;   /**< Background snapshot restored by lite_clear_box(), NULL if none */
+
+     LiteBoxType           type;               /**< LiteBox type */
+     DFBRectangle          rect;               /**< Rectangle of the LiteBox, see lite_reinit_box_and_children() */
+     IDirectFBSurface     *surface;            /**< LiteBox surface */
+     DFBColor             *background;         /**< Background color */
+     void                 *user_data;          /**< User data */
+     int                   is_focused;         /**< LiteBox is focused or not */
+     int                   is_visible;         /**< LiteBox is visible or not, changed with lite_set_box_visible() */
+     int                   is_opaque;          /**< LiteBox covers all of its area with opaque pixels or not */
+     int                   is_active;          /**< LiteBox receives input events or not */
+     int                   catches_all_events; /**< LiteBox prevents events from being handled by its children or not */
+     int                   handle_keys;        /**< LiteBox handles keyboard events or not */
+     int                   is_fixed;           /**< LiteBox and its children keep their geometry on resizes or not */
+
+     struct {
+          unsigned int      serial;         /**< Geometry serial the cache is valid for */
+          int               x;              /**< X coordinate relative to the top level box */
+          int               y;              /**< Y coordinate relative to the top level box */
+          DFBRegion         clip;           /**< Visible area relative to the top level box */
+          int               visible;        /**< LiteBox and all of its ancestors are visible or not */
+          struct _LiteBox  *root;           /**< Top level box */
+     } cached;                              /**< Geometry cache, refreshed after changes made with the LiteBox API */
+
+     struct {
+          int               x;              /**< X coordinate relative to the top level box */
+          int               y;              /**< Y coordinate relative to the top level box */
+          int               w;              /**< Width */
+          int               h;              /**< Height */
+          int               clipped;        /**< Sub surface is clipped by an ancestor or not */
+          int               stale;          /**< Sub surface must be made again before drawing or not */
+     } sub;                                 /**< Area of the sub surface when it was made */
 
      int              (*OnFocusIn)        ( struct _LiteBox                *self );
                                             /**< Focus in callback */
@@ -222,6 +261,14 @@ DFBResult lite_init_box_at                 ( LiteBox            *box,
  * @brief Reinitialize the LiteBox and its children.
  *
  * This function will reinitialize the LiteBox and all children.
+ * It must be called after changing the rectangle of a LiteBox.
+ * The geometry of boxes is cached for drawing, hit testing and
+ * updates, so writing rect directly without calling it, or
+ * writing is_visible instead of calling lite_set_box_visible(),
+ * leaves input and updates going to the old geometry.
+ * Sub surfaces are made again when the boxes are drawn, and only
+ * if their area changed. Children of a box with is_fixed set are
+ * not visited if the area of the box did not change.
  *
  * @param[in]  box                           Valid LiteBox
  *
@@ -236,6 +283,9 @@ DFBResult lite_reinit_box_and_children     ( LiteBox *box );
  * specified region.
  * If NULL is passed, the entire LiteBox will be cleared.
  * This operation includes updates to the parent area.
+ * The background of a LiteBox that is cleared frequently is kept
+ * in a snapshot and restored with a single blit, until one of its
+ * ancestors is updated or the geometry changes.
  *
  * @param[in]  box                           Valid LiteBox
  * @param[in]  region                        Region
@@ -259,6 +309,25 @@ DFBResult lite_clear_box                   ( LiteBox         *box,
 DFBResult lite_add_child                   ( LiteBox *parent,
                                              LiteBox *child );
 
+/**
+ * @brief Add several LiteBox children in the parent's child array.
+ *
+ * This function will add a number of LiteBox children in the
+ * parent's child array at once, like lite_add_child() but growing
+ * the child array only once. The window is notified with a single
+ * OnBoxesAdded() callback if installed, otherwise with OnBoxAdded()
+ * for each child.
+ *
+ * @param[in]  parent                        Valid LiteBox
+ * @param[in]  children                      Array of valid LiteBox
+ * @param[in]  num                           Number of children
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_add_children                ( LiteBox  *parent,
+                                             LiteBox **children,
+                                             int       num );
+
 /**
  * @brief Remove a LiteBox child from the parent's child array.
  *
@@ -286,6 +355,58 @@ DFBResult lite_remove_child                ( LiteBox *parent,
 DFBResult lite_set_box_visible             ( LiteBox *box,
                                              int      visible );
 
+/**
+ * @brief Enable a spatial index of the children of a LiteBox.
+ *
+ * This function will enable or disable a grid based index used to
+ * find the child under the pointer without scanning all children.
+ * It is meant for containers with many children, and is rebuilt
+ * lazily after a child is added or removed, or after
+ * lite_reinit_box_and_children() has been called to apply new
+ * geometry.
+ *
+ * @param[in]  box                           Valid LiteBox
+ * @param[in]  enable                        Enable the index or not
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_set_box_index               ( LiteBox *box,
+                                             int      enable );
+
+/**
+ * @brief Cache a LiteBox and its children in a surface.
+ *
+ * This function will enable or disable caching of a LiteBox.
+ * Once the LiteBox and its children have been drawn completely,
+ * the result is kept in an offscreen surface and blitted instead
+ * of calling the Draw() callbacks, until a box of the subtree is
+ * updated with lite_update_box(). Such an update redraws the whole
+ * LiteBox to refill the cache, so this is meant for static content.
+ * The cache of a box that is not opaque also holds what lies
+ * beneath, and is dropped when that area is updated or the box
+ * moves. Caches are evicted least recently used first to stay
+ * within the "cache-memory" limit.
+ *
+ * @param[in]  box                           Valid LiteBox
+ * @param[in]  enable                        Enable the cache or not
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_set_box_cache               ( LiteBox *box,
+                                             int      enable );
+
+/**
+ * @brief Get box cache statistics.
+ *
+ * This function will retrieve statistics about the caches of all
+ * LiteBoxes.
+ *
+ * @param[out] ret_stats                     Cache statistics
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_box_cache_stats         ( LiteBoxCacheStats *ret_stats );
+
 /**
  * @brief Set focus to a specific LiteBox.
  *
@@ -33,6 +33,7 @@ struct _LiteCheck {
 
      LiteFont              *font;
      char                  *caption_text;
+     LiteEllipsis           ellipsis;
      int                    hilite;
      int                    enabled;
      LiteCheckState         state;
@@ -98,6 +99,7 @@ lite_new_check( LiteBox         *parent,
      check->box.Draw       = draw_check;
      check->box.Destroy    = destroy_check;
      check->caption_text   = D_STRDUP( caption_text );
+     check->ellipsis       = LITE_ELLIPSIS_END;
      check->enabled        = 1;
      check->state          = LITE_CHS_UNCHECKED;
 
@@ -128,6 +130,26 @@ lite_set_check_caption( LiteCheck  *check,
      return lite_update_box( LITE_BOX(check), NULL );
 }
 
+DFBResult
+lite_set_check_ellipsis( LiteCheck    *check,
+                         LiteEllipsis  ellipsis )
+{
+     LITE_NULL_PARAMETER_CHECK( check );
+     LITE_BOX_TYPE_PARAMETER_CHECK( check, LITE_TYPE_CHECK );
+
+     D_DEBUG_AT( LiteCheckDomain, "Set check: %p with ellipsis: %u\n", check, ellipsis );
+
+     if (ellipsis > LITE_ELLIPSIS_START)
+          return DFB_INVARG;
+
+     if (check->ellipsis == ellipsis)
+          return DFB_OK;
+
+     check->ellipsis = ellipsis;
+
+     return lite_update_box( LITE_BOX(check), NULL );
+}
+
 DFBResult
 lite_enable_check( LiteCheck *check,
                    int        enabled )
@@ -430,9 +452,8 @@ draw_check( LiteBox         *box,
 
           surface->SetFont( surface, font );
 
-          strncpy( truncated_text, check->caption_text, sizeof(truncated_text) );
-          truncated_text[sizeof(truncated_text)-1] = 0;
-          prvlite_make_truncated_text( truncated_text, box->rect.w - (rect_image.w + MARKER_CAPTION_GAP), font );
+          prvlite_make_truncated_text( check->caption_text, box->rect.w - (rect_image.w + MARKER_CAPTION_GAP), font,
+                                       check->ellipsis, truncated_text, sizeof(truncated_text) );
 
           font->GetHeight( font, &font_height );
 
@@ -29,6 +29,7 @@ extern "C" {
 #endif
 
 #include <lite/box.h>
+#include <lite/font.h>
 #include <lite/theme.h>
 
 /** @brief Macro to convert a generic LiteBox into a LiteCheck. */
@@ -86,8 +87,8 @@ DFBResult lite_new_check                   ( LiteBox         *parent,
  * @brief Set the check box caption text.
  *
  * This function will set the caption text of the check box.
- * If the string is too long, part of the end of the string will
- * be drawn as "...".
+ * If the string is too long, part of the string will be drawn
+ * as "...", at the end unless set by lite_set_check_ellipsis().
  *
  * @param[in]  check                         Valid LiteCheck object
  * @param[in]  caption_text                  Check box caption text
@@ -97,6 +98,20 @@ DFBResult lite_new_check                   ( LiteBox         *parent,
 DFBResult lite_set_check_caption           ( LiteCheck  *check,
                                              const char *caption_text );
 
+/**
+ * @brief Set the position of the ellipsis in the caption text.
+ *
+ * This function will set which part of a caption text too long
+ * for the check box is replaced by "...".
+ *
+ * @param[in]  check                         Valid LiteCheck object
+ * @param[in]  ellipsis                      Position of the ellipsis
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_set_check_ellipsis          ( LiteCheck    *check,
+                                             LiteEllipsis  ellipsis );
+
 /**
  * @brief Enable/disable check box control.
  *
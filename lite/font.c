@@ -17,6 +17,7 @@
 */
 
 #include <direct/thread.h>
+#include <direct/utf8.h>
 #include <lite/font.h>
 #include <lite/lite_config.h>
 #include <lite/lite_internal.h>
@@ -39,24 +40,89 @@ D_DEBUG_DOMAIN( LiteFontDomain, "LiTE/Font", "LiTE Font" );
 
 /**********************************************************************************************************************/
 
+#define LITE_FONT_HASH_SIZE 64
+
+/* estimated number of glyphs rendered into the glyph cache of a font */
+#define LITE_FONT_CACHE_GLYPHS 128
+
+#define LITE_TRUNCATED_TEXTS 64
+
+#define LITE_TEXT_LAYOUTS 256
+
 struct _LiteFont {
-     int                refs;
+     int                 refs;
+
+     char               *id;
+     int                 size;
+     IDirectFBFont      *font;
+     DFBFontAttributes   attr;
+
+     unsigned int        hash;
+     unsigned long long  memory;           /* estimated size of the glyph cache */
+     int                 loading;          /* font being loaded by a thread, without the cache lock */
+
+     LiteFont           *next;
+     LiteFont           *prev;
 
-     char              *id;
-     int                size;
-     IDirectFBFont     *font;
-     DFBFontAttributes  attr;
+     LiteFont           *hash_next;
 
-     LiteFont          *next;
-     LiteFont          *prev;
+     LiteFont           *lru_next;         /* less recently released */
+     LiteFont           *lru_prev;
 };
 
 char *lite_font_styles[4] = {
      "", "Bd", "It", "BI"
 };
 
-static LiteFont    *fonts       = NULL;
-static DirectMutex  fonts_mutex = DIRECT_MUTEX_INITIALIZER();
+static LiteFont          *fonts       = NULL;
+static DirectMutex        fonts_mutex = DIRECT_MUTEX_INITIALIZER();
+static DirectWaitQueue    fonts_queue;                  /* signaled when a font finished loading */
+
+static LiteFont          *font_hash[LITE_FONT_HASH_SIZE];
+
+static LiteFont          *lru_first   = NULL; /* unreferenced fonts kept loaded, most recently released first */
+static LiteFont          *lru_last    = NULL;
+
+static LiteFontCacheStats font_stats;
+
+typedef struct _LiteFontPreloadJob {
+     LiteFontPreload             *fonts;
+     LiteFont                   **loaded;
+     int                          num_fonts;
+     char                        *glyphs;
+
+     DirectThread                *thread;
+
+     struct _LiteFontPreloadJob  *next;
+} LiteFontPreloadJob;
+
+static LiteFontPreloadJob *preload_jobs   = NULL; /* running or finished preloads, joined on shutdown */
+static bool                preload_cancel = false;
+
+typedef struct {
+     unsigned int   hash;
+     IDirectFBFont *font;
+     int            width;
+     LiteEllipsis   ellipsis;
+     int            size;
+     char          *text;
+     char          *result;
+} LiteTruncatedText;
+
+static LiteTruncatedText truncated_texts[LITE_TRUNCATED_TEXTS]; /* truncation results, replaced on collision */
+
+typedef struct {
+     unsigned int    hash;
+     LiteFont       *font;
+     char           *text;
+     int             bytes;
+     LiteTextFlags   flags;               /* measurements done in addition to the width */
+     LiteTextLayout  layout;
+     int            *offsets;             /* byte offset of each glyph and of the end, with LITE_TEXT_GLYPHS */
+     int            *positions;           /* position of each glyph and of the end, with LITE_TEXT_GLYPHS */
+} LiteTextLayoutEntry;
+
+static LiteTextLayoutEntry text_layouts[LITE_TEXT_LAYOUTS]; /* measured texts, replaced on collision */
 
 #ifndef LITEFONTDIR
 struct LiteFontData {
@@ -100,16 +166,32 @@ static const struct LiteFontSize font_size[] = {
 
 /* return an existing font entry from the cache after increasing its reference count, otherwise try creating a new one
    by specifying a font file or a font name */
-static LiteFont *cache_get_entry            ( const char *name, int size, DFBFontAttributes attr );
+static LiteFont      *cache_get_entry      ( const char *name, int size, DFBFontAttributes attr );
 #ifdef LITEFONTDIR
-static LiteFont *cache_get_entry_from_file  ( const char *file, int size, DFBFontAttributes attr );
+static IDirectFBFont *load_font_from_file  ( const char *file, int size, DFBFontAttributes attr );
 #else
-static LiteFont *cache_get_entry_from_memory( const char *name, int size, DFBFontAttributes attr );
+static IDirectFBFont *load_font_from_memory( const char *name, int size, DFBFontAttributes attr );
 #endif
 
-/* decrease the reference count of a cache entry and remove/destroy it if the count is zero */
+/* decrease the reference count of a cache entry and keep it in the LRU list or destroy it if the count is zero */
 static void cache_release_entry( LiteFont *entry );
 
+static unsigned int  cache_hash  ( const char *name, int size, DFBFontAttributes attr );
+static LiteFont     *cache_lookup( const char *name, int size, DFBFontAttributes attr, unsigned int hash );
+static void          cache_remove( LiteFont *entry );
+static LiteFont     *cache_trim  ( void );
+static void          cache_destroy( LiteFont *evicted );
+static void          lru_remove  ( LiteFont *entry );
+
+static void         *preload_main( DirectThread *thread, void *arg );
+
+static void          truncated_texts_forget( IDirectFBFont *font );
+
+/* measure text from the text layout cache or measure it and replace the cache entry, position of offset in ret_x */
+static void          text_layout_get    ( LiteFont *font, const char *text, int bytes, LiteTextFlags flags,
+                                          LiteTextLayout *ret_layout, int offset, int *ret_x );
+static void          text_layouts_forget( LiteFont *font );
+
 /**********************************************************************************************************************/
 
 DFBResult
@@ -313,40 +395,143 @@ lite_get_font_attributes( LiteFont          *font,
      return DFB_OK;
 }
 
-/* internals */
+DFBResult
+lite_get_font_cache_stats( LiteFontCacheStats *ret_stats )
+{
+     LITE_NULL_PARAMETER_CHECK( ret_stats );
 
-#ifdef LITEFONTDIR
-static LiteFont *
-cache_get_entry_from_file( const char        *file,
-                           int                size,
-                           DFBFontAttributes  attr )
+     D_DEBUG_AT( LiteFontDomain, "Get font cache statistics\n" );
+
+     direct_mutex_lock( &fonts_mutex );
+
+     *ret_stats = font_stats;
+
+     direct_mutex_unlock( &fonts_mutex );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_measure_text( LiteFont       *font,
+                   const char     *text,
+                   int             bytes,
+                   LiteTextFlags   flags,
+                   LiteTextLayout *ret_layout )
 {
-     DFBResult           ret;
-     DFBFontDescription  desc;
-     IDirectFBFont      *font;
-     LiteFont           *entry;
+     LITE_NULL_PARAMETER_CHECK( font );
+     LITE_NULL_PARAMETER_CHECK( text );
+     LITE_NULL_PARAMETER_CHECK( ret_layout );
 
-     D_ASSERT( file != NULL );
+     D_DEBUG_AT( LiteFontDomain, "Measure text with font: %p (flags: 0x%x)\n", font, flags );
+
+     if (bytes < 0)
+          bytes = strlen( text );
+
+     text_layout_get( font, text, bytes, flags, ret_layout, 0, NULL );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_get_text_position( LiteFont   *font,
+                        const char *text,
+                        int         offset,
+                        int        *ret_x )
+{
+     LITE_NULL_PARAMETER_CHECK( font );
+     LITE_NULL_PARAMETER_CHECK( text );
+     LITE_NULL_PARAMETER_CHECK( ret_x );
+
+     D_DEBUG_AT( LiteFontDomain, "Get text position at offset: %d with font: %p\n", offset, font );
+
+     text_layout_get( font, text, strlen( text ), LITE_TEXT_GLYPHS, NULL, offset, ret_x );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_preload_fonts( const LiteFontPreload *fonts,
+                    int                    num_fonts,
+                    const char            *glyphs )
+{
+     int                 i;
+     LiteFontPreloadJob *job;
+
+     LITE_NULL_PARAMETER_CHECK( fonts );
+
+     D_DEBUG_AT( LiteFontDomain, "Preload %d fonts\n", num_fonts );
+
+     if (num_fonts < 1)
+          return DFB_INVARG;
+
+     /* copy the list, the thread outlives the call */
+     job = D_CALLOC( 1, sizeof(LiteFontPreloadJob) );
+
+     job->fonts     = D_CALLOC( num_fonts, sizeof(LiteFontPreload) );
+     job->loaded    = D_CALLOC( num_fonts, sizeof(LiteFont*) );
+     job->num_fonts = num_fonts;
+
+     for (i = 0; i < num_fonts; i++) {
+          job->fonts[i]      = fonts[i];
+          job->fonts[i].spec = D_STRDUP( fonts[i].spec );
+     }
+
+     if (glyphs)
+          job->glyphs = D_STRDUP( glyphs );
 
-     /* lock cache */
      direct_mutex_lock( &fonts_mutex );
 
-     /* look for an existing font entry in the cache */
-     for (entry = fonts; entry; entry = entry->next) {
-          if (!strcmp( file, entry->id ) && size == entry->size && attr == entry->attr) {
-               entry->refs++;
+     job->next    = preload_jobs;
+     preload_jobs = job;
 
-               D_DEBUG_AT( LiteFontDomain, "Existing cache entry '%s' with size: %d and attr: 0x%x (refs %d)\n",
-                           file, size, entry->attr, entry->refs );
+     job->thread = direct_thread_create( DTT_DEFAULT, preload_main, job, "LiTE Font Preload" );
 
-               /* unlock cache */
-               direct_mutex_unlock( &fonts_mutex );
+     direct_mutex_unlock( &fonts_mutex );
 
-               return entry;
-          }
+     return DFB_OK;
+}
+
+/* internals */
+
+static void *
+preload_main( DirectThread *thread,
+              void         *arg )
+{
+     int                 i;
+     DFBRectangle        ink_rect;
+     LiteFontPreloadJob *job = arg;
+
+     for (i = 0; i < job->num_fonts && !preload_cancel; i++) {
+          LiteFontPreload *preload = &job->fonts[i];
+
+          D_DEBUG_AT( LiteFontDomain, "Preloading font '%s' with size: %d\n", preload->spec, preload->size );
+
+          /* a lite_get_font() call for the same font meanwhile waits for this load */
+          if (lite_get_font( preload->spec, preload->style, preload->size, preload->attr, &job->loaded[i] ))
+               continue;
+
+          /* measuring renders the glyphs into the glyph cache of the font */
+          if (job->glyphs)
+               job->loaded[i]->font->GetStringExtents( job->loaded[i]->font, job->glyphs, -1, NULL, &ink_rect );
      }
 
-     D_DEBUG_AT( LiteFontDomain, "Loading cache entry '%s' with size: %d and attr: 0x%x\n", file, size, attr );
+     return NULL;
+}
+
+
+#ifdef LITEFONTDIR
+static IDirectFBFont *
+load_font_from_file( const char        *file,
+                     int                size,
+                     DFBFontAttributes  attr )
+{
+     DFBResult           ret;
+     DFBFontDescription  desc;
+     IDirectFBFont      *font;
+
+     D_ASSERT( file != NULL );
+
+     D_DEBUG_AT( LiteFontDomain, "Loading font '%s' with size: %d and attr: 0x%x\n", file, size, attr );
 
      /* load the font */
      desc.flags      = DFDESC_ATTRIBUTES | DFDESC_HEIGHT;
@@ -356,41 +541,18 @@ cache_get_entry_from_file( const char        *file,
      ret = lite_dfb->CreateFont( lite_dfb, file, &desc, &font );
      if (ret) {
           DirectFBError( "LiTE/Font: CreateFont() failed", ret );
-
-          /* unlock cache */
-          direct_mutex_unlock( &fonts_mutex );
-
           return NULL;
      }
-     else
-          D_DEBUG_AT( LiteFontDomain, "  -> interface: %p\n", font );
 
-     /* create a new entry for it */
-     entry = D_CALLOC( 1, sizeof(LiteFont) );
-
-     entry->refs = 1;
-     entry->id   = D_STRDUP( file );
-     entry->size = size;
-     entry->font = font;
-     entry->attr = attr;
+     D_DEBUG_AT( LiteFontDomain, "  -> interface: %p\n", font );
 
-     /* insert into cache */
-     if (fonts) {
-          fonts->prev = entry;
-          entry->next = fonts;
-     }
-     fonts = entry;
-
-     /* unlock cache */
-     direct_mutex_unlock( &fonts_mutex );
-
-     return entry;
+     return font;
 }
 #else
-static LiteFont *
-cache_get_entry_from_memory( const char        *name,
-                             int                size,
-                             DFBFontAttributes  attr )
+static IDirectFBFont *
+load_font_from_memory( const char        *name,
+                       int                size,
+                       DFBFontAttributes  attr )
 {
      DFBResult                 ret;
      int                       i;
@@ -398,40 +560,26 @@ cache_get_entry_from_memory( const char        *name,
      DFBDataBufferDescription  ddsc;
      IDirectFBDataBuffer      *buffer;
      IDirectFBFont            *font;
-     LiteFont                 *entry;
 
      D_ASSERT( name != NULL );
 
-     /* lock cache */
-     direct_mutex_lock( &fonts_mutex );
+     D_DEBUG_AT( LiteFontDomain, "Loading font '%s' with size: %d and attr: 0x%x\n", name, size, attr );
 
-     /* look for an existing font entry in the cache */
-     for (entry = fonts; entry; entry = entry->next) {
-          if (!strcmp( name, entry->id ) && size == entry->size && attr == entry->attr) {
-               entry->refs++;
-
-               D_DEBUG_AT( LiteFontDomain, "Existing cache entry '%s' with size: %d and attr: 0x%x (refs %d)\n",
-                           name, size, entry->attr, entry->refs );
-
-               /* unlock cache */
-               direct_mutex_unlock( &fonts_mutex );
-
-               return entry;
-          }
+     for (i = 0; i < D_ARRAY_SIZE(font_data); i++) {
+          if (!strcmp( name, font_data[i].name ))
+               break;
      }
 
-     D_DEBUG_AT( LiteFontDomain, "Loading cache entry '%s' with size: %d and attr: 0x%x\n", name, size, attr );
+     if (i == D_ARRAY_SIZE(font_data)) {
+          D_DEBUG_AT( LiteFontDomain, "  -> no built-in font '%s'\n", name );
+          return NULL;
+     }
 
      /* load the font */
      desc.flags      = DFDESC_ATTRIBUTES | DFDESC_HEIGHT;
      desc.attributes = attr;
      desc.height     = size;
 
-     for (i = 0; i < D_ARRAY_SIZE(font_data); i++) {
-          if (!strcmp( name, font_data[i].name ))
-               break;
-     }
-
      ddsc.flags         = DBDESC_MEMORY;
      ddsc.memory.data   = font_data[i].data;
      ddsc.memory.length = font_size[i].size;
@@ -439,35 +587,113 @@ cache_get_entry_from_memory( const char        *name,
      ret = lite_dfb->CreateDataBuffer( lite_dfb, &ddsc, &buffer );
      if (ret) {
           DirectFBError( "LiTE/Font: CreateDataBuffer() failed", ret );
-
-          /* unlock cache */
-          direct_mutex_unlock( &fonts_mutex );
-
           return NULL;
      }
 
      ret = buffer->CreateFont( buffer, &desc, &font );
      if (ret) {
           DirectFBError( "LiTE/Font: CreateFont() failed", ret );
-
           buffer->Release( buffer );
+          return NULL;
+     }
+
+     D_DEBUG_AT( LiteFontDomain, "  -> interface: %p\n", font );
+
+     return font;
+}
+#endif
+
+static unsigned int
+cache_hash( const char        *name,
+            int                size,
+            DFBFontAttributes  attr )
+{
+     unsigned int hash = 2166136261u;
+
+     /* FNV-1a over the name, then the size and attributes */
+     while (*name)
+          hash = (hash ^ (unsigned char) *name++) * 16777619u;
+
+     hash = (hash ^ (unsigned int) size) * 16777619u;
+     hash = (hash ^ (unsigned int) attr) * 16777619u;
+
+     return hash;
+}
+
+static LiteFont *
+cache_lookup( const char        *name,
+              int                size,
+              DFBFontAttributes  attr,
+              unsigned int       hash )
+{
+     LiteFont *entry;
+
+     for (entry = font_hash[hash % LITE_FONT_HASH_SIZE]; entry; entry = entry->hash_next) {
+          if (entry->hash == hash && size == entry->size && attr == entry->attr && !strcmp( name, entry->id ))
+               return entry;
+     }
+
+     return NULL;
+}
+
+static LiteFont *
+cache_get_entry( const char        *name,
+                 int                size,
+                 DFBFontAttributes  attr )
+{
+     unsigned int   hash = cache_hash( name, size, attr );
+     IDirectFBFont *font = NULL;
+     LiteFont      *entry;
+     LiteFont      *evicted;
+#ifdef LITEFONTDIR
+     int            len  = strlen( LITEFONTDIR ) + 1 + strlen( name ) + 6 + 1;
+     char           file[len];
+#endif
+
+     D_ASSERT( name != NULL );
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     /* look for an existing font entry in the cache, loaded fonts are found by name before trying any file */
+     while ((entry = cache_lookup( name, size, attr, hash )) != NULL && entry->loading) {
+          D_DEBUG_AT( LiteFontDomain, "Waiting for cache entry '%s' with size: %d and attr: 0x%x\n", name, size, attr );
+
+          font_stats.waits++;
+
+          /* another thread is loading the font, the entry is gone if loading failed */
+          direct_waitqueue_wait( &fonts_queue, &fonts_mutex );
+     }
+
+     if (entry) {
+          if (!entry->refs)
+               lru_remove( entry );
+
+          entry->refs++;
+
+          font_stats.hits++;
+
+          D_DEBUG_AT( LiteFontDomain, "Existing cache entry '%s' with size: %d and attr: 0x%x (refs %d)\n",
+                      name, size, entry->attr, entry->refs );
 
           /* unlock cache */
           direct_mutex_unlock( &fonts_mutex );
 
-          return NULL;
+          return entry;
      }
-     else
-          D_DEBUG_AT( LiteFontDomain, "  -> interface: %p\n", font );
 
-     /* create a new entry for it */
+     font_stats.misses++;
+
+     /* create a new entry for it, marked as loading for other threads asking for the same font */
      entry = D_CALLOC( 1, sizeof(LiteFont) );
 
-     entry->refs = 1;
-     entry->id   = D_STRDUP( name );
-     entry->size = size;
-     entry->font = font;
-     entry->attr = attr;
+     entry->refs    = 1;
+     entry->id      = D_STRDUP( name );
+     entry->size    = size;
+     entry->attr    = attr;
+     entry->hash    = hash;
+     entry->memory  = (unsigned long long) size * size * LITE_FONT_CACHE_GLYPHS;
+     entry->loading = 1;
 
      /* insert into cache */
      if (fonts) {
@@ -476,48 +702,134 @@ cache_get_entry_from_memory( const char        *name,
      }
      fonts = entry;
 
-     /* unlock cache */
-     direct_mutex_unlock( &fonts_mutex );
+     entry->hash_next                      = font_hash[hash % LITE_FONT_HASH_SIZE];
+     font_hash[hash % LITE_FONT_HASH_SIZE] = entry;
 
-     return entry;
-}
-#endif
+     font_stats.memory += entry->memory;
 
-static LiteFont *
-cache_get_entry( const char        *name,
-                 int                size,
-                 DFBFontAttributes  attr )
-{
-     LiteFont *entry = NULL;
-#ifdef LITEFONTDIR
-     int       len   = strlen( LITEFONTDIR ) + 1 + strlen( name ) + 6 + 1;
-     char      file[len];
-
-     D_ASSERT( name != NULL );
+     /* unlock cache while loading */
+     direct_mutex_unlock( &fonts_mutex );
 
-     if (!getenv( "LITE_NO_DGIFF" )) {
+#ifdef LITEFONTDIR
+     if (!lite_config.no_dgiff) {
           /* first try to load a font in DGIFF format */
           snprintf( file, len, LITEFONTDIR"/%s.dgiff", name );
-          entry = cache_get_entry_from_file( file, size, attr );
+          font = load_font_from_file( file, size, attr );
      }
 
-     if (entry == NULL) {
+     if (font == NULL) {
           /* otherwise fall back on a font in TTF format */
           snprintf( file, len, LITEFONTDIR"/%s.ttf", name );
-          entry = cache_get_entry_from_file( file, size, attr );
+          font = load_font_from_file( file, size, attr );
      }
 #else
-     D_ASSERT( name != NULL );
-
-     entry = cache_get_entry_from_memory( name, size, attr );
+     font = load_font_from_memory( name, size, attr );
 #endif
 
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     entry->font    = font;
+     entry->loading = 0;
+
+     direct_waitqueue_broadcast( &fonts_queue );
+
+     if (font == NULL) {
+          cache_remove( entry );
+
+          /* unlock cache */
+          direct_mutex_unlock( &fonts_mutex );
+
+          D_FREE( entry->id );
+          D_FREE( entry );
+
+          return NULL;
+     }
+
+     /* the new font may push unreferenced fonts over the memory limit */
+     evicted = cache_trim();
+
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
+
+     cache_destroy( evicted );
+
      return entry;
 }
 
+static void
+cache_remove( LiteFont *entry )
+{
+     LiteFont **link;
+
+     /* remove entry from cache */
+     if (entry->next)
+          entry->next->prev = entry->prev;
+     if (entry->prev)
+          entry->prev->next = entry->next;
+     else
+          fonts = entry->next;
+
+     for (link = &font_hash[entry->hash % LITE_FONT_HASH_SIZE]; *link; link = &(*link)->hash_next) {
+          if (*link == entry) {
+               *link = entry->hash_next;
+               break;
+          }
+     }
+
+     font_stats.memory -= entry->memory;
+}
+
+static void
+lru_remove( LiteFont *entry )
+{
+     if (entry->lru_next)
+          entry->lru_next->lru_prev = entry->lru_prev;
+     else
+          lru_last = entry->lru_prev;
+
+     if (entry->lru_prev)
+          entry->lru_prev->lru_next = entry->lru_next;
+     else
+          lru_first = entry->lru_next;
+
+     entry->lru_next = NULL;
+     entry->lru_prev = NULL;
+
+     font_stats.cached--;
+}
+
+/* remove the least recently released fonts beyond the limits, returning them linked by lru_next to be destroyed */
+static LiteFont *
+cache_trim()
+{
+     LiteFont           *evicted = NULL;
+     unsigned long long  limit   = lite_config.font_cache_memory * 1024ULL;
+
+     while (lru_last && (font_stats.cached > lite_config.font_cache || font_stats.memory > limit)) {
+          LiteFont *entry = lru_last;
+
+          D_DEBUG_AT( LiteFontDomain, "Evicting cache entry '%s' with size: %d and attr: 0x%x\n",
+                      entry->id, entry->size, entry->attr );
+
+          lru_remove( entry );
+
+          cache_remove( entry );
+
+          font_stats.evictions++;
+
+          entry->lru_next = evicted;
+          evicted         = entry;
+     }
+
+     return evicted;
+}
+
 static void
 cache_release_entry( LiteFont *entry )
 {
+     LiteFont *evicted;
+
      D_ASSERT( entry != NULL );
 
      /* lock cache */
@@ -535,24 +847,81 @@ cache_release_entry( LiteFont *entry )
           return;
      }
 
-     D_DEBUG_AT( LiteFontDomain, "Destroying cache entry '%s' with size: %d and attr: 0x%x (interface: %p)\n",
+     D_DEBUG_AT( LiteFontDomain, "Keeping unreferenced cache entry '%s' with size: %d and attr: 0x%x (interface: %p)\n",
                  entry->id, entry->size, entry->attr, entry->font );
 
-     /* remove entry from cache */
-     if (entry->next)
-          entry->next->prev = entry->prev;
-     if (entry->prev)
-          entry->prev->next = entry->next;
+     /* keep the font loaded as the most recently released one, the limits decide what is destroyed */
+     entry->lru_prev = NULL;
+     entry->lru_next = lru_first;
+
+     if (lru_first)
+          lru_first->lru_prev = entry;
      else
-          fonts = entry->next;
+          lru_last = entry;
+
+     lru_first = entry;
+
+     font_stats.cached++;
+
+     evicted = cache_trim();
 
      /* unlock cache */
      direct_mutex_unlock( &fonts_mutex );
 
+     cache_destroy( evicted );
+}
+
+static void
+cache_destroy( LiteFont *evicted )
+{
      /* free font resources */
-     entry->font->Release( entry->font );
-     D_FREE( entry->id );
-     D_FREE( entry );
+     while (evicted) {
+          LiteFont *next = evicted->lru_next;
+
+          D_DEBUG_AT( LiteFontDomain, "Destroying cache entry '%s' (interface: %p)\n", evicted->id, evicted->font );
+
+          truncated_texts_forget( evicted->font );
+          text_layouts_forget( evicted );
+
+          evicted->font->Release( evicted->font );
+          D_FREE( evicted->id );
+          D_FREE( evicted );
+
+          evicted = next;
+     }
+}
+
+/* drop the truncation results of a font, NULL for all fonts */
+static void
+truncated_texts_forget( IDirectFBFont *font )
+{
+     int i;
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     for (i = 0; i < LITE_TRUNCATED_TEXTS; i++) {
+          LiteTruncatedText *entry = &truncated_texts[i];
+
+          if (entry->text && (!font || entry->font == font)) {
+               D_FREE( entry->text );
+               D_FREE( entry->result );
+
+               entry->text   = NULL;
+               entry->result = NULL;
+          }
+     }
+
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
+}
+
+void
+prvlite_init_font_resources()
+{
+     direct_waitqueue_init( &fonts_queue );
+
+     preload_cancel = false;
 }
 
 DFBResult
@@ -560,52 +929,442 @@ prvlite_release_font_resources()
 {
      LiteFont *entry, *temp;
 
+     /* stop preloading, the fonts loaded so far are released below */
+     preload_cancel = true;
+
+     while (preload_jobs) {
+          LiteFontPreloadJob *job = preload_jobs;
+          int                 i;
+
+          preload_jobs = job->next;
+
+          if (job->thread) {
+               direct_thread_join( job->thread );
+               direct_thread_destroy( job->thread );
+          }
+
+          for (i = 0; i < job->num_fonts; i++)
+               D_FREE( (char*) job->fonts[i].spec );
+
+          if (job->glyphs)
+               D_FREE( job->glyphs );
+
+          D_FREE( job->loaded );
+          D_FREE( job->fonts );
+          D_FREE( job );
+     }
+
      for (entry = fonts, temp = entry ? entry->next : NULL; entry; entry = temp, temp = entry ? entry->next : NULL) {
           entry->font->Release( entry->font );
           D_FREE( entry->id );
           D_FREE( entry );
      }
 
-     fonts = NULL;
+     truncated_texts_forget( NULL );
+     text_layouts_forget( NULL );
+
+     fonts     = NULL;
+     lru_first = NULL;
+     lru_last  = NULL;
+
+     memset( font_hash, 0, sizeof(font_hash) );
+     memset( &font_stats, 0, sizeof(font_stats) );
+
+     direct_waitqueue_deinit( &fonts_queue );
 
      return DFB_OK;
 }
 
+/* largest number of leading characters fitting in the width and bytes */
+static int
+fit_head( const int *advance,
+          const int *offset,
+          int        num,
+          int        width,
+          int        bytes )
+{
+     int lo = 0, hi = num;
+
+     while (lo < hi) {
+          int mid = (lo + hi + 1) / 2;
+
+          if (advance[mid] <= width && offset[mid] <= bytes)
+               lo = mid;
+          else
+               hi = mid - 1;
+     }
+
+     return lo;
+}
+
+/* first character of the shortest tail, starting at min or later, fitting in the width and bytes */
+static int
+fit_tail( const int *advance,
+          const int *offset,
+          int        num,
+          int        min,
+          int        width,
+          int        bytes )
+{
+     int lo = min, hi = num;
+
+     while (lo < hi) {
+          int mid = (lo + hi) / 2;
+
+          if (advance[num] - advance[mid] <= width && offset[num] - offset[mid] <= bytes)
+               hi = mid;
+          else
+               lo = mid + 1;
+     }
+
+     return lo;
+}
+
+static void
+truncate_text( const char    *text,
+               int            width,
+               IDirectFBFont *font,
+               LiteEllipsis   ellipsis,
+               char          *buffer,
+               int            size )
+{
+     int         i, n, num;
+     int         head  = 0;
+     int         tail;
+     int         text_width;
+     int         tail_width;
+     int         len   = strlen( text );
+     int        *advance;
+     int        *offset;
+     const char *dots  = "...";
+
+     /* fast path, the text fits */
+     if (len < size) {
+          font->GetStringWidth( font, text, len, &text_width );
+          if (text_width <= width) {
+               memcpy( buffer, text, len + 1 );
+               return;
+          }
+     }
+
+     font->GetStringWidth( font, dots, 3, &tail_width );
+     if (tail_width >= width || size < 4) {
+          snprintf( buffer, size, "%s", dots );
+          return;
+     }
+
+     /* byte offset and accumulated advance before each character, kerning is ignored which errs on the safe side */
+     advance = D_MALLOC( (len + 1) * sizeof(int) );
+     offset  = D_MALLOC( (len + 1) * sizeof(int) );
+
+     advance[0] = 0;
+     offset[0]  = 0;
+
+     for (i = 0, num = 0; i < len; i += n) {
+          int glyph_advance = 0;
+
+          n = DIRECT_UTF8_SKIP( text[i] );
+
+          /* a sequence cut short by the end of the text is measured as a replacement character */
+          if (n > len - i) {
+               n = len - i;
+               font->GetGlyphAdvance( font, '?', &glyph_advance );
+          }
+          else
+               font->GetGlyphAdvance( font, DIRECT_UTF8_GET_CHAR( &text[i] ), &glyph_advance );
+
+          num++;
+
+          advance[num] = advance[num-1] + glyph_advance;
+          offset[num]  = i + n;
+     }
+
+     width -= tail_width;
+     size  -= 4;
+
+     switch (ellipsis) {
+          case LITE_ELLIPSIS_START:
+               tail = fit_tail( advance, offset, num, 0, width, size );
+               break;
+
+          case LITE_ELLIPSIS_MIDDLE:
+               head = fit_head( advance, offset, num, width / 2, size / 2 );
+               tail = fit_tail( advance, offset, num, head, width - advance[head], size - offset[head] );
+               break;
+
+          default:
+               head = fit_head( advance, offset, num, width, size );
+               tail = num;
+               break;
+     }
+
+     D_DEBUG_AT( LiteFontDomain, "  -> keeping %d + %d of %d characters\n", head, num - tail, num );
+
+     memcpy( buffer, text, offset[head] );
+     memcpy( buffer + offset[head], dots, 3 );
+     memcpy( buffer + offset[head] + 3, text + offset[tail], len - offset[tail] + 1 );
+
+     D_FREE( advance );
+     D_FREE( offset );
+}
+
 void
-prvlite_make_truncated_text( char          *text,
+prvlite_make_truncated_text( const char    *text,
                              int            width,
-                             IDirectFBFont *font )
+                             IDirectFBFont *font,
+                             LiteEllipsis   ellipsis,
+                             char          *buffer,
+                             int            size )
 {
-     DFBRectangle  ink_rect;
-     int           i;
-     char         *buffer;
-     const char   *tail = "...";
+     unsigned int        hash;
+     LiteTruncatedText  *entry;
 
-     font->GetStringExtents( font, text, -1, NULL, &ink_rect );
-     if (ink_rect.w <= width)
+     D_ASSERT( text != NULL );
+     D_ASSERT( font != NULL );
+     D_ASSERT( buffer != NULL );
+
+     if (size < 1)
           return;
 
-     font->GetStringExtents( font, tail, -1, NULL, &ink_rect );
-     if (ink_rect.w >= width) {
-          strncpy( text, tail, strlen( text ) );
+     hash = cache_hash( text, width, ellipsis );
+     hash = (hash ^ (unsigned int) size) * 16777619u;
+     hash = (hash ^ (unsigned int) (unsigned long) font) * 16777619u;
+
+     entry = &truncated_texts[hash % LITE_TRUNCATED_TEXTS];
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     if (entry->text && entry->hash == hash && entry->font == font && entry->width == width &&
+         entry->ellipsis == ellipsis && entry->size == size && !strcmp( entry->text, text )) {
+          strcpy( buffer, entry->result );
+
+          /* unlock cache */
+          direct_mutex_unlock( &fonts_mutex );
+
           return;
      }
 
-     buffer = calloc( strlen( text ) + 4, 1 );
-     strncpy( buffer, text, MAX( 0, strlen( text ) - 3 ) );
-     strcat( buffer, tail );
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
 
-     while (1) {
-          font->GetStringExtents( font, buffer, -1, NULL, &ink_rect );
-          if (ink_rect.w <= width)
-               break;
+     D_DEBUG_AT( LiteFontDomain, "Truncate '%s' to width: %d\n", text, width );
+
+     truncate_text( text, width, font, ellipsis, buffer, size );
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     if (entry->text) {
+          D_FREE( entry->text );
+          D_FREE( entry->result );
+     }
+
+     entry->hash     = hash;
+     entry->font     = font;
+     entry->width    = width;
+     entry->ellipsis = ellipsis;
+     entry->size     = size;
+     entry->text     = D_STRDUP( text );
+     entry->result   = D_STRDUP( buffer );
+
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
+}
+
+static void
+text_layout_measure( IDirectFBFont       *font,
+                     const char          *text,
+                     int                  bytes,
+                     LiteTextFlags        flags,
+                     LiteTextLayoutEntry *ret_entry )
+{
+     int           i, n, num;
+     unsigned int  prev = 0;
+     int          *offsets;
+     int          *positions;
 
-          i = strlen( buffer );
-          buffer[i-1] = 0;
-          buffer[i-4] = '.';
+     if (flags & LITE_TEXT_EXTENTS)
+          font->GetStringExtents( font, text, bytes, &ret_entry->layout.logical, &ret_entry->layout.ink );
+
+     if (!(flags & LITE_TEXT_GLYPHS)) {
+          font->GetStringWidth( font, text, bytes, &ret_entry->layout.width );
+          return;
      }
 
-     strcpy( text, buffer );
+     /* glyphs are placed like DrawString() does, kerning moves a glyph relative to the previous one */
+     offsets   = D_MALLOC( (bytes + 1) * sizeof(int) );
+     positions = D_MALLOC( (bytes + 1) * sizeof(int) );
+
+     offsets[0]   = 0;
+     positions[0] = 0;
+
+     for (i = 0, num = 0; i < bytes; i += n, num++) {
+          unsigned int c;
+          int          advance = 0;
+          int          kern_x  = 0;
+          int          kern_y  = 0;
+
+          n = DIRECT_UTF8_SKIP( text[i] );
+
+          /* a sequence cut short by the end of the text is measured as a replacement character */
+          if (n > bytes - i) {
+               n = bytes - i;
+               c = '?';
+          }
+          else
+               c = DIRECT_UTF8_GET_CHAR( &text[i] );
+
+          if (num) {
+               font->GetKerning( font, prev, c, &kern_x, &kern_y );
+               positions[num] += kern_x;
+          }
 
-     free( buffer );
+          font->GetGlyphAdvance( font, c, &advance );
+
+          offsets[num+1]   = i + n;
+          positions[num+1] = positions[num] + advance;
+
+          prev = c;
+     }
+
+     ret_entry->layout.width      = positions[num];
+     ret_entry->layout.num_glyphs = num;
+     ret_entry->offsets           = offsets;
+     ret_entry->positions         = positions;
+}
+
+/* copy the results of a cache entry, called with the cache lock */
+static void
+text_layout_result( const LiteTextLayoutEntry *entry,
+                    LiteTextLayout            *ret_layout,
+                    int                        offset,
+                    int                       *ret_x )
+{
+     if (ret_layout)
+          *ret_layout = entry->layout;
+
+     if (ret_x) {
+          int lo = 0, hi = entry->layout.num_glyphs;
+
+          /* last glyph starting at the offset or before */
+          while (lo < hi) {
+               int mid = (lo + hi + 1) / 2;
+
+               if (entry->offsets[mid] <= offset)
+                    lo = mid;
+               else
+                    hi = mid - 1;
+          }
+
+          *ret_x = entry->positions[lo];
+     }
+}
+
+static void
+text_layout_clear( LiteTextLayoutEntry *entry )
+{
+     if (entry->text)
+          D_FREE( entry->text );
+
+     if (entry->offsets) {
+          D_FREE( entry->offsets );
+          D_FREE( entry->positions );
+     }
+
+     memset( entry, 0, sizeof(LiteTextLayoutEntry) );
+}
+
+static void
+text_layout_get( LiteFont       *font,
+                 const char     *text,
+                 int             bytes,
+                 LiteTextFlags   flags,
+                 LiteTextLayout *ret_layout,
+                 int             offset,
+                 int            *ret_x )
+{
+     int                  i;
+     unsigned int         hash = 2166136261u;
+     LiteTextLayoutEntry *entry;
+     LiteTextLayoutEntry  measured;
+
+     for (i = 0; i < bytes; i++)
+          hash = (hash ^ (unsigned char) text[i]) * 16777619u;
+
+     hash = (hash ^ (unsigned int) (unsigned long) font) * 16777619u;
+
+     entry = &text_layouts[hash % LITE_TEXT_LAYOUTS];
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     if (entry->text && entry->hash == hash && entry->font == font && entry->bytes == bytes &&
+         !memcmp( entry->text, text, bytes )) {
+          if ((entry->flags & flags) == flags) {
+               font_stats.text_hits++;
+
+               text_layout_result( entry, ret_layout, offset, ret_x );
+
+               /* unlock cache */
+               direct_mutex_unlock( &fonts_mutex );
+
+               return;
+          }
+
+          /* measure again with the additional flags, keeping the previous ones */
+          flags |= entry->flags;
+     }
+
+     font_stats.text_misses++;
+
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
+
+     D_DEBUG_AT( LiteFontDomain, "  -> measuring %d bytes (flags: 0x%x)\n", bytes, flags );
+
+     memset( &measured, 0, sizeof(measured) );
+
+     text_layout_measure( font->font, text, bytes, flags, &measured );
+
+     measured.hash  = hash;
+     measured.font  = font;
+     measured.bytes = bytes;
+     measured.flags = flags;
+     measured.text  = D_MALLOC( bytes + 1 );
+
+     memcpy( measured.text, text, bytes );
+     measured.text[bytes] = 0;
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     text_layout_clear( entry );
+
+     *entry = measured;
+
+     text_layout_result( entry, ret_layout, offset, ret_x );
+
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
+}
+
+/* drop the text layouts of a font, NULL for all fonts */
+static void
+text_layouts_forget( LiteFont *font )
+{
+     int i;
+
+     /* lock cache */
+     direct_mutex_lock( &fonts_mutex );
+
+     for (i = 0; i < LITE_TEXT_LAYOUTS; i++) {
+          LiteTextLayoutEntry *entry = &text_layouts[i];
+
+          if (entry->text && (!font || entry->font == font))
+               text_layout_clear( entry );
+     }
+
+     /* unlock cache */
+     direct_mutex_unlock( &fonts_mutex );
 }
@@ -37,12 +37,54 @@ typedef enum {
   LITE_FONT_ITALIC = 2  /**< Italics font */
 } LiteFontStyle;
 
+/** @brief Position of the ellipsis in truncated text. */
+typedef enum {
+  LITE_ELLIPSIS_END    = 0, /**< Keep the start of the text */
+  LITE_ELLIPSIS_MIDDLE = 1, /**< Keep the start and the end of the text */
+  LITE_ELLIPSIS_START  = 2  /**< Keep the end of the text */
+} LiteEllipsis;
+
 /** @brief LiteFont structure. */
 typedef struct _LiteFont LiteFont;
 
 /** @brief Default font attribute. */
 #define DEFAULT_FONT_ATTRIBUTE DFFA_NONE
 
+/** @brief Font cache statistics. */
+typedef struct {
+     unsigned int        hits;              /**< Fonts found in the cache by lite_get_font() */
+     unsigned int        misses;            /**< Fonts loaded because they were not in the cache */
+     unsigned int        evictions;         /**< Unreferenced fonts destroyed to stay within the limits */
+     unsigned int        cached;            /**< Unreferenced fonts kept loaded */
+     unsigned long long  memory;            /**< Estimated glyph cache memory of all loaded fonts (bytes) */
+     unsigned int        waits;             /**< lite_get_font() calls that waited for a font being loaded */
+     unsigned int        text_hits;         /**< Text measurements found in the text layout cache */
+     unsigned int        text_misses;       /**< Text measurements done because they were not in the cache */
+} LiteFontCacheStats;
+
+/** @brief Text measurement flags. */
+typedef enum {
+  LITE_TEXT_WIDTH   = 0x00000000, /**< Measure the width only */
+  LITE_TEXT_EXTENTS = 0x00000001, /**< Also measure the logical and ink extents */
+  LITE_TEXT_GLYPHS  = 0x00000002  /**< Also measure the position of each glyph */
+} LiteTextFlags;
+
+/** @brief Text layout measured by lite_measure_text(). */
+typedef struct {
+     int                 width;             /**< Width of the text, the sum of glyph advances and kerning */
+     DFBRectangle        logical;           /**< Logical extents, with LITE_TEXT_EXTENTS */
+     DFBRectangle        ink;               /**< Ink extents, with LITE_TEXT_EXTENTS */
+     int                 num_glyphs;        /**< Number of glyphs, with LITE_TEXT_GLYPHS */
+} LiteTextLayout;
+
+/** @brief Font to be loaded by lite_preload_fonts(). */
+typedef struct {
+     const char         *spec;              /**< Font specification */
+     LiteFontStyle       style;             /**< Font style */
+     int                 size;              /**< Font size */
+     DFBFontAttributes   attr;              /**< Font attributes */
+} LiteFontPreload;
+
 /**
  * @brief Get a LiteFont object based on specifications.
  *
@@ -80,7 +122,10 @@ DFBResult lite_ref_font                    ( LiteFont *font );
  * @brief Release a LiteFont object.
  *
  * This function will decrease the reference count of a LiteFont,
- * so this LiteFont object can eventually be purged.
+ * so this LiteFont object can eventually be purged. Unreferenced
+ * fonts are kept loaded for later lite_get_font() calls, within the
+ * "font-cache" and "font-cache-memory" limits, the least recently
+ * released ones being purged first.
  *
  * @param[in]  font                          Valid LiteFont object
  *
@@ -142,6 +187,81 @@ DFBResult lite_get_active_font             ( LiteBox   *box,
 DFBResult lite_get_font_attributes         ( LiteFont          *font,
                                              DFBFontAttributes *ret_attr );
 
+/**
+ * @brief Load fonts in the background.
+ *
+ * This function will load fonts on a background thread and return
+ * immediately, it is meant to be called right after lite_open().
+ * If glyphs is not NULL, these UTF-8 characters are rendered into
+ * the glyph cache of each font. A lite_get_font() call for a font
+ * being loaded waits for it instead of loading it again. Preloaded
+ * fonts stay loaded until lite_close().
+ *
+ * @param[in]  fonts                         Fonts to be loaded
+ * @param[in]  num_fonts                     Number of fonts
+ * @param[in]  glyphs                        Characters to render or NULL
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_preload_fonts               ( const LiteFontPreload *fonts,
+                                             int                    num_fonts,
+                                             const char            *glyphs );
+
+/**
+ * @brief Get font cache statistics.
+ *
+ * This function will retrieve statistics about the cache of
+ * loaded fonts.
+ *
+ * @param[out] ret_stats                     Cache statistics
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_font_cache_stats        ( LiteFontCacheStats *ret_stats );
+
+/**
+ * @brief Measure text.
+ *
+ * This function will measure UTF-8 text drawn with the font. The
+ * results are kept in a text layout cache shared by all widgets,
+ * so measuring the same text again is cheap. The cache entries of
+ * a font are dropped when the font is destroyed.
+ *
+ * @param[in]  font                          Valid LiteFont object
+ * @param[in]  text                          UTF-8 text
+ * @param[in]  bytes                         Length of the text in bytes or -1 if zero terminated
+ * @param[in]  flags                         Measurements in addition to the width
+ * @param[out] ret_layout                    Text layout
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_measure_text                ( LiteFont           *font,
+                                             const char         *text,
+                                             int                 bytes,
+                                             LiteTextFlags       flags,
+                                             LiteTextLayout     *ret_layout );
+
+/**
+ * @brief Get the position of a character in text.
+ *
+ * This function will retrieve the horizontal position of the
+ * character at a byte offset of zero terminated UTF-8 text drawn
+ * with the font, using the glyph positions from the text layout
+ * cache. An offset inside a character gives the position of this
+ * character, an offset past the end gives the width of the text.
+ *
+ * @param[in]  font                          Valid LiteFont object
+ * @param[in]  text                          UTF-8 text
+ * @param[in]  offset                        Byte offset of the character
+ * @param[out] ret_x                         Position of the character
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_text_position           ( LiteFont           *font,
+                                             const char         *text,
+                                             int                 offset,
+                                             int                *ret_x );
+
 #ifdef __cplusplus
 }
 #endif
@@ -107,6 +107,9 @@ load_image( LiteImage    *image,
      else
           image->blitting_flags = DSBLIT_NOFX;
 
+     /* the image is stretched over the whole box */
+     image->box.is_opaque = (image->blitting_flags == DSBLIT_NOFX);
+
      return lite_update_box( LITE_BOX(image), NULL );
 }
 
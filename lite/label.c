@@ -180,6 +180,7 @@ draw_label( LiteBox         *box,
      DFBResult            ret;
      IDirectFBFont       *font;
      IDirectFBSurface    *surface;
+     LiteTextLayout       layout;
      int                  x     = 0;
      DFBSurfaceTextFlags  flags = DSTF_TOP;
      LiteLabel           *label = LITE_LABEL(box);
@@ -207,13 +208,16 @@ draw_label( LiteBox         *box,
                break;
 
           case LITE_LABEL_RIGHT:
-               x = box->rect.w - 1;
-               flags |= DSTF_RIGHT;
-               break;
-
           case LITE_LABEL_CENTER:
-               x = box->rect.w / 2;
-               flags |= DSTF_CENTER;
+               /* align with the cached width instead of letting DrawString() measure the text each time */
+               lite_measure_text( label->font, label->text, -1, LITE_TEXT_WIDTH, &layout );
+
+               if (label->alignment == LITE_LABEL_RIGHT)
+                    x = box->rect.w - 1 - layout.width;
+               else
+                    x = box->rect.w / 2 - layout.width / 2;
+
+               flags |= DSTF_LEFT;
                break;
      }
 
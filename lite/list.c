@@ -438,6 +438,8 @@ lite_list_recalc_layout( LiteList *list )
 
      LITE_BOX(list->scrollbar)->rect = scrollbar_rect;
 
+     lite_reinit_box_and_children( LITE_BOX(list->scrollbar) );
+
      lite_get_scroll_info( list->scrollbar, &info );
 
      info.page_size = list->box.rect.h;
@@ -27,9 +27,9 @@
 #include <lite/scrollbar.h>
 #include <lite/textbutton.h>
 
-#ifdef LITEIMAGEDIR
 #include <direct/filesystem.h>
-#else
+
+#ifndef LITEIMAGEDIR
 #include "bottom.h"
 #include "bottomleft.h"
 #include "bottomright.h"
@@ -57,11 +57,148 @@ D_DEBUG_DOMAIN( LiteCoreDomain, "LiTE/Core", "LiTE Core" );
 
 /**********************************************************************************************************************/
 
-IDirectFB             *lite_dfb   = NULL;
-IDirectFBDisplayLayer *lite_layer = NULL;
+IDirectFB             *lite_dfb    = NULL;
+IDirectFBDisplayLayer *lite_layer  = NULL;
+LiteConfig             lite_config = { .minimum_update_freq = DEFAULT_MINIMUM_UPDATE_FREQ,
+                                       .frame_rate          = DEFAULT_FRAME_RATE,
+                                       .max_updates         = DEFAULT_MAX_UPDATES,
+                                       .cache_memory        = DEFAULT_CACHE_MEMORY,
+                                       .font_cache          = DEFAULT_FONT_CACHE,
+                                       .font_cache_memory   = DEFAULT_FONT_CACHE_MEMORY };
+
+static LiteCursor lite_cursor        = { NULL, 0, 0 };
+static int        lite_refs          = 0;
+static bool       lite_config_inited = false;
+
+/**********************************************************************************************************************/
+
+typedef enum {
+     LITE_CONFIG_BOOLEAN,
+     LITE_CONFIG_INTEGER
+} LiteConfigOptionType;
+
+typedef struct {
+     const char           *name;               /* option name in the configuration file */
+     const char           *env;                /* environment variable */
+     LiteConfigOptionType  type;               /* option type */
+     size_t                offset;             /* field offset in LiteConfig */
+} LiteConfigOption;
+
+static const LiteConfigOption config_options[] = {
+     { "bounding-updates",    "LITE_BOUNDING_UPDATES",    LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, bounding_updates)    },
+     { "debug-updates",       "LITE_DEBUG_UPDATES",       LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, debug_updates)       },
+     { "window-doublebuffer", "LITE_WINDOW_DOUBLEBUFFER", LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, window_doublebuffer) },
+     { "no-frame",            "LITE_NO_FRAME",            LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, no_frame)            },
+     { "no-cursor",           "LITE_NO_CURSOR",           LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, no_cursor)           },
+     { "no-dfiff",            "LITE_NO_DFIFF",            LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, no_dfiff)            },
+     { "no-dgiff",            "LITE_NO_DGIFF",            LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, no_dgiff)            },
+     { "minimum-update-freq", "LITE_MINIMUM_UPDATE_FREQ", LITE_CONFIG_INTEGER, offsetof(LiteConfig, minimum_update_freq) },
+     { "frame-rate",          "LITE_FRAME_RATE",          LITE_CONFIG_INTEGER, offsetof(LiteConfig, frame_rate)          },
+     { "wait-for-sync",       "LITE_WAIT_FOR_SYNC",       LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, wait_for_sync)       },
+     { "latency-dump",        "LITE_LATENCY_DUMP",        LITE_CONFIG_BOOLEAN, offsetof(LiteConfig, latency_dump)        },
+     { "max-updates",         "LITE_MAX_UPDATES",         LITE_CONFIG_INTEGER, offsetof(LiteConfig, max_updates)         },
+     { "cache-memory",        "LITE_CACHE_MEMORY",        LITE_CONFIG_INTEGER, offsetof(LiteConfig, cache_memory)        },
+     { "font-cache",          "LITE_FONT_CACHE",          LITE_CONFIG_INTEGER, offsetof(LiteConfig, font_cache)          },
+     { "font-cache-memory",   "LITE_FONT_CACHE_MEMORY",   LITE_CONFIG_INTEGER, offsetof(LiteConfig, font_cache_memory)   }
+};
+
+static void
+config_set_option( const LiteConfigOption *option,
+                   const char             *value )
+{
+     void *field = (char*) &lite_config + option->offset;
+
+     switch (option->type) {
+          case LITE_CONFIG_BOOLEAN:
+               /* a boolean option without value or with any value other than "0", "no" or "false" is enabled */
+               *(DFBBoolean*) field = (value && (!strcmp( value, "0" ) ||
+                                                 !strcasecmp( value, "no" ) ||
+                                                 !strcasecmp( value, "false" ))) ? DFB_FALSE : DFB_TRUE;
+               break;
+
+          case LITE_CONFIG_INTEGER:
+               if (value)
+                    *(int*) field = MAX( 0, atoi( value ) );
+               else
+                    D_ERROR( "LiTE/Core: Option '%s' requires a value!\n", option->name );
+               break;
+     }
+}
+
+static void
+config_read_file( const char *filename )
+{
+     DirectResult ret;
+     DirectFile   fd;
+     char         line[256];
+
+     D_DEBUG_AT( LiteCoreDomain, "Reading configuration file '%s'\n", filename );
+
+     ret = direct_file_open( &fd, filename, O_RDONLY, 0 );
+     if (ret) {
+          D_DEBUG_AT( LiteCoreDomain, "  -> could not open file\n" );
+          return;
+     }
+
+     while (!direct_file_get_string( &fd, line, sizeof(line) )) {
+          int   i;
+          char *name  = line;
+          char *value = NULL;
+          char *end;
+
+          while (*name == ' ' || *name == '\t')
+               name++;
+
+          if (*name == '#' || *name == '\0' || *name == '\n')
+               continue;
+
+          end = name + strcspn( name, "\r\n" );
+          while (end > name && (end[-1] == ' ' || end[-1] == '\t'))
+               end--;
+          *end = '\0';
+
+          value = strchr( name, '=' );
+          if (value)
+               *value++ = '\0';
+
+          for (i = 0; i < D_ARRAY_SIZE(config_options); i++) {
+               if (!strcmp( name, config_options[i].name )) {
+                    config_set_option( &config_options[i], value );
+                    break;
+               }
+          }
+
+          if (i == D_ARRAY_SIZE(config_options))
+               D_ERROR( "LiTE/Core: Unknown option '%s' in configuration file '%s'!\n", name, filename );
+     }
+
+     direct_file_close( &fd );
+}
+
+void
+prvlite_init_config()
+{
+     int         i;
+     const char *filename;
+
+     if (lite_config_inited)
+          return;
+
+     lite_config_inited = true;
+
+     D_DEBUG_AT( LiteCoreDomain, "Initialize runtime configuration\n" );
 
-static LiteCursor lite_cursor = { NULL, 0, 0 };
-static int        lite_refs   = 0;
+     filename = getenv( "LITE_CONFIG" );
+     if (filename)
+          config_read_file( filename );
+
+     for (i = 0; i < D_ARRAY_SIZE(config_options); i++) {
+          const char *value = getenv( config_options[i].env );
+
+          if (value)
+               config_set_option( &config_options[i], value );
+     }
+}
 
 /**********************************************************************************************************************/
 
@@ -78,7 +215,7 @@ get_image_path( const char *name )
      len  = strlen( LITEIMAGEDIR ) + 1 + strlen( name ) + 6 + 1;
      path = alloca( len );
 
-     if (!getenv( "LITE_NO_DFIFF" )) {
+     if (!lite_config.no_dfiff) {
           /* first try to find an image in DFIFF format */
           snprintf( path, len, LITEIMAGEDIR"/%s.dfiff", name );
           ret = direct_access( path, R_OK );
@@ -107,6 +244,8 @@ lite_open( int   *argc,
 
           D_DEBUG_AT( LiteCoreDomain, "Open new LiTE instance...\n" );
 
+          prvlite_init_config();
+
           ret = DirectFBInit( argc, argv );
           if (ret) {
                DirectFBError( "LiTE/Core: DirectFBInit() failed", ret );
@@ -125,12 +264,14 @@ lite_open( int   *argc,
                goto error;
           }
 
+          prvlite_init_font_resources();
+
           for (i = 0; i < D_ARRAY_SIZE(length); i++)
                length[i] = 0;
 
           /* default window theme */
 
-          if (!getenv( "LITE_NO_FRAME" )) {
+          if (!lite_config.no_frame) {
                DFBColor bg_color;
 
                bg_color.r = DEFAULT_WINDOW_COLOR_R;
@@ -313,7 +454,7 @@ lite_open( int   *argc,
 
           /* default cursor */
 
-          if (!getenv( "LITE_NO_CURSOR" )) {
+          if (!lite_config.no_cursor) {
 #ifdef LITEIMAGEDIR
                file_data[0] = get_image_path( DEFAULT_WINDOW_CURSOR );
 #else
@@ -483,3 +624,36 @@ lite_get_layer_size( int *ret_width,
 
      return DFB_OK;
 }
+
+DFBResult
+lite_get_config( LiteConfig *ret_config )
+{
+     LITE_NULL_PARAMETER_CHECK( ret_config );
+
+     D_DEBUG_AT( LiteCoreDomain, "Get runtime configuration\n" );
+
+     prvlite_init_config();
+
+     *ret_config = lite_config;
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_set_config( const LiteConfig *config )
+{
+     LITE_NULL_PARAMETER_CHECK( config );
+
+     D_DEBUG_AT( LiteCoreDomain, "Set runtime configuration\n" );
+
+     if (config->minimum_update_freq < 0 || config->frame_rate < 0 || config->max_updates < 1 ||
+         config->cache_memory < 0 || config->font_cache < 0 || config->font_cache_memory < 0)
+          return DFB_INVARG;
+
+     /* read the configuration file and the environment first, so they don't override this configuration later */
+     prvlite_init_config();
+
+     lite_config = *config;
+
+     return DFB_OK;
+}
@@ -36,6 +36,51 @@ extern "C" {
 
 #include <directfb.h>
 
+/** @brief LiTE runtime configuration.
+ *
+ * The configuration is read once, on the first lite_open(), lite_get_config() or lite_set_config() call.
+ * Built-in defaults are overridden by the file named by the LITE_CONFIG environment variable,
+ * then by the environment variables below, then by lite_set_config().
+ * The configuration file contains one "option" or "option=value" entry per line, lines starting with '#' are ignored.
+ * A boolean option is enabled unless its value is "0", "no" or "false", in the file and in the environment alike.
+ */
+typedef struct {
+     DFBBoolean bounding_updates;         /**< Draw the bounding box of all pending updates in a single pass
+                                               ("bounding-updates" / LITE_BOUNDING_UPDATES, default off). */
+     DFBBoolean debug_updates;            /**< Fill updated areas before drawing them
+                                               ("debug-updates" / LITE_DEBUG_UPDATES, default off). */
+     DFBBoolean window_doublebuffer;      /**< Create double buffered windows and flip by blitting, to be set before
+                                               creating windows ("window-doublebuffer" / LITE_WINDOW_DOUBLEBUFFER,
+                                               default off). */
+     DFBBoolean no_frame;                 /**< Don't create the default window frame theme
+                                               ("no-frame" / LITE_NO_FRAME, default off). */
+     DFBBoolean no_cursor;                /**< Don't load the default cursor
+                                               ("no-cursor" / LITE_NO_CURSOR, default off). */
+     DFBBoolean no_dfiff;                 /**< Don't look for images in DFIFF format
+                                               ("no-dfiff" / LITE_NO_DFIFF, default off). */
+     DFBBoolean no_dgiff;                 /**< Don't look for fonts in DGIFF format
+                                               ("no-dgiff" / LITE_NO_DGIFF, default off). */
+     int        minimum_update_freq;      /**< Maximum time in milliseconds that window updates are delayed
+                                               while events keep arriving, 0 to draw after each event
+                                               ("minimum-update-freq" / LITE_MINIMUM_UPDATE_FREQ, default 200). */
+     int        frame_rate;               /**< Target number of frames per second, window updates are coalesced into
+                                               one draw per frame, 0 to draw as soon as events are processed
+                                               ("frame-rate" / LITE_FRAME_RATE, default 0). */
+     DFBBoolean wait_for_sync;            /**< Wait for the vertical retrace of the layer before drawing a frame
+                                               ("wait-for-sync" / LITE_WAIT_FOR_SYNC, default off). */
+     DFBBoolean latency_dump;             /**< Print the input to present latency of each window when it is destroyed
+                                               ("latency-dump" / LITE_LATENCY_DUMP, default off). */
+     int        max_updates;              /**< Maximum number of update regions per window, up to
+                                               LITE_WINDOW_MAX_UPDATES ("max-updates" / LITE_MAX_UPDATES, default 8). */
+     int        cache_memory;             /**< Memory limit of box caches in kilobytes
+                                               ("cache-memory" / LITE_CACHE_MEMORY, default 8192). */
+     int        font_cache;               /**< Number of unreferenced fonts kept loaded
+                                               ("font-cache" / LITE_FONT_CACHE, default 16). */
+     int        font_cache_memory;        /**< Estimated memory limit of loaded fonts in kilobytes, above which
+                                               unreferenced fonts are destroyed
+                                               ("font-cache-memory" / LITE_FONT_CACHE_MEMORY, default 2048). */
+} LiteConfig;
+
 /**
  * @brief Start the LiTE framework.
  *
@@ -92,6 +137,30 @@ lite_get_layer_interface                   ( void );
 DFBResult lite_get_layer_size              ( int *ret_width,
                                              int *ret_height );
 
+/**
+ * @brief Get the runtime configuration.
+ *
+ * This function will retrieve the current LiTE runtime configuration.
+ *
+ * @param ret_config                         Configuration
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_config                  ( LiteConfig       *ret_config );
+
+/**
+ * @brief Set the runtime configuration.
+ *
+ * This function will replace the LiTE runtime configuration.
+ * It can be called before lite_open() to override the
+ * configuration file and the environment variables.
+ *
+ * @param config                             Configuration
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_set_config                  ( const LiteConfig *config );
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,24 @@
 extern "C" {
 #endif
 
+/** @brief Default maximum delay of window updates while events keep arriving (milliseconds). */
+#define DEFAULT_MINIMUM_UPDATE_FREQ       200
+
+/** @brief Default target frame rate (frames per second, 0 for no frame clock). */
+#define DEFAULT_FRAME_RATE                0
+
+/** @brief Default maximum number of update regions per window. */
+#define DEFAULT_MAX_UPDATES               8
+
+/** @brief Default memory limit of box caches (kilobytes). */
+#define DEFAULT_CACHE_MEMORY              8192
+
+/** @brief Default number of unreferenced fonts kept loaded. */
+#define DEFAULT_FONT_CACHE                16
+
+/** @brief Default estimated memory limit of loaded fonts (kilobytes). */
+#define DEFAULT_FONT_CACHE_MEMORY         2048
+
 /** @brief Default window title font. */
 #define DEFAULT_WINDOW_TITLE_FONT         "whitrabt"
 
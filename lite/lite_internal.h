@@ -19,7 +19,9 @@
 #ifndef __LITE__LITE_INTERNAL_H__
 #define __LITE__LITE_INTERNAL_H__
 
-#include <directfb.h>
+#include <lite/box.h>
+#include <lite/font.h>
+#include <lite/lite.h>
 
 /* test for NULL parameter, return DFB_INVARG if NULL */
 #define LITE_NULL_PARAMETER_CHECK(exp) \
@@ -35,19 +37,56 @@ extern IDirectFB *lite_dfb;
 /* pointer to the display layer interface */
 extern IDirectFBDisplayLayer *lite_layer;
 
+/* runtime configuration */
+extern LiteConfig lite_config;
+
+/* read the runtime configuration once */
+void      prvlite_init_config              ( void );
+
 /* font styles */
 extern char *lite_font_styles[4];
 
 /* clean up resources allocated for window usage on app shutdown */
 DFBResult prvlite_release_window_resources ( void );
 
+/* set up font loading on app startup */
+void      prvlite_init_font_resources      ( void );
+
 /* clean up resources allocated for font usage on app shutdown */
 DFBResult prvlite_release_font_resources   ( void );
 
-/* truncate text */
-void      prvlite_make_truncated_text      ( char          *text,
+/* find the topmost visible child of a box containing a point, NULL if none */
+LiteBox  *prvlite_box_child_at             ( LiteBox       *box,
+                                             int            x,
+                                             int            y );
+
+/* refresh the cached geometry of a box if the box tree has changed */
+void      prvlite_box_validate             ( LiteBox       *box );
+
+/* invalidate the caches and background snapshots affected by an update of a box, region in top level coordinates */
+void      prvlite_box_damage               ( LiteBox         *box,
+                                             const DFBRegion *region );
+
+/* queue an update of a window caused by a box, floor is the box if it is opaque */
+DFBResult prvlite_update_window            ( struct _LiteWindow *window,
+                                             const DFBRegion    *region,
+                                             LiteBox            *floor );
+
+/* draw a dirty area of a window from its floor upwards, or completely if floor is NULL */
+void      prvlite_draw_dirty_area          ( struct _LiteWindow *window,
+                                             const DFBRegion    *region,
+                                             LiteBox            *floor );
+
+/* current geometry serial of the box tree */
+unsigned int prvlite_box_geometry_serial   ( void );
+
+/* truncate UTF-8 text to a width with an ellipsis into a buffer of the given size, results are cached */
+void      prvlite_make_truncated_text      ( const char    *text,
                                              int            width,
-                                             IDirectFBFont *font );
+                                             IDirectFBFont *font,
+                                             LiteEllipsis   ellipsis,
+                                             char          *buffer,
+                                             int            size );
 
 /* load an image */
 DFBResult prvlite_load_image               ( const void           *filedata,
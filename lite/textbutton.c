@@ -33,6 +33,7 @@ struct _LiteTextButton {
 
      LiteFont                *font;
      char                    *caption_text;
+     LiteEllipsis             ellipsis;
      int                      enabled;
      LiteTextButtonState      state;
      struct {
@@ -99,6 +100,7 @@ lite_new_text_button( LiteBox              *parent,
      textbutton->box.Draw         = draw_text_button;
      textbutton->box.Destroy      = destroy_text_button;
      textbutton->caption_text     = D_STRDUP( caption_text );
+     textbutton->ellipsis         = LITE_ELLIPSIS_END;
      textbutton->enabled          = 1;
      textbutton->state            = LITE_TBS_NORMAL;
 
@@ -127,6 +129,26 @@ lite_set_text_button_caption( LiteTextButton *textbutton,
      return lite_update_box( LITE_BOX(textbutton), NULL );
 }
 
+DFBResult
+lite_set_text_button_ellipsis( LiteTextButton *textbutton,
+                               LiteEllipsis    ellipsis )
+{
+     LITE_NULL_PARAMETER_CHECK( textbutton );
+     LITE_BOX_TYPE_PARAMETER_CHECK( textbutton, LITE_TYPE_TEXT_BUTTON );
+
+     D_DEBUG_AT( LiteTextButtonDomain, "Set textbutton: %p with ellipsis: %u\n", textbutton, ellipsis );
+
+     if (ellipsis > LITE_ELLIPSIS_START)
+          return DFB_INVARG;
+
+     if (textbutton->ellipsis == ellipsis)
+          return DFB_OK;
+
+     textbutton->ellipsis = ellipsis;
+
+     return lite_update_box( LITE_BOX(textbutton), NULL );
+}
+
 DFBResult
 lite_enable_text_button( LiteTextButton *textbutton,
                          int             enabled )
@@ -497,9 +519,8 @@ draw_text_button( LiteBox         *box,
 
           surface->SetFont( surface, font );
 
-          strncpy( truncated_text, textbutton->caption_text, sizeof(truncated_text) );
-          truncated_text[sizeof(truncated_text)-1] = 0;
-          prvlite_make_truncated_text( truncated_text, box->rect.w - 2 * IMG_MARGIN, font );
+          prvlite_make_truncated_text( textbutton->caption_text, box->rect.w - 2 * IMG_MARGIN, font,
+                                       textbutton->ellipsis, truncated_text, sizeof(truncated_text) );
 
           font->GetHeight( font, &font_height );
 
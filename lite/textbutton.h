@@ -29,6 +29,7 @@ extern "C" {
 #endif
 
 #include <lite/box.h>
+#include <lite/font.h>
 #include <lite/theme.h>
 
 /** @brief Macro to convert a generic LiteBox into a LiteTextButton. */
@@ -89,8 +90,8 @@ DFBResult lite_new_text_button             ( LiteBox              *parent,
  * @brief Set the button caption text.
  *
  * This function will set the caption text of the button.
- * If the string is too long, part of the end of the string will
- * be drawn as "...".
+ * If the string is too long, part of the string will be drawn
+ * as "...", at the end unless set by lite_set_text_button_ellipsis().
  *
  * @param[in]  textbutton                    Valid LiteTextButton object
  * @param[in]  caption_text                  Button caption text
@@ -100,6 +101,20 @@ DFBResult lite_new_text_button             ( LiteBox              *parent,
 DFBResult lite_set_text_button_caption     ( LiteTextButton *textbutton,
                                              const char     *caption_text );
 
+/**
+ * @brief Set the position of the ellipsis in the caption text.
+ *
+ * This function will set which part of a caption text too long
+ * for the button is replaced by "...".
+ *
+ * @param[in]  textbutton                    Valid LiteTextButton object
+ * @param[in]  ellipsis                      Position of the ellipsis
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_set_text_button_ellipsis    ( LiteTextButton *textbutton,
+                                             LiteEllipsis    ellipsis );
+
 /**
  * @brief Enable/disable text button.
  *
@@ -456,7 +456,7 @@ draw_textline( LiteBox         *box,
      surface->FillRectangle( surface, 2, 2, box->rect.w - 4, box->rect.h - 4 );
 
      /* draw the text */
-     font->GetStringWidth( font, textline->text, textline->cursor_pos, &cursor_x );
+     lite_get_text_position( textline->font, textline->text, textline->cursor_pos, &cursor_x );
      surface->SetColor( surface, 0x30, 0x30, 0x30, 0xff );
      text_x = 5;
      if (cursor_x > box->rect.w - 5)
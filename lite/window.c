@@ -16,6 +16,9 @@
    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
+#include <direct/atomic.h>
+#include <direct/filesystem.h>
+#include <direct/hash.h>
 #include <direct/memcpy.h>
 #include <directfb_util.h>
 #include <lite/cursor.h>
@@ -33,23 +36,103 @@ LiteWindowTheme *liteDefaultWindowTheme = NULL;
 
 typedef struct _LiteWindowTimeout {
      long long                  timeout;       /* time in milliseconds that triggers the timeout */
+     long long                  serial;        /* enqueue order, keeps timeouts with the same trigger time FIFO */
      int                        id;            /* id value used to remove the timeout callback */
+     int                        index;         /* position of the timeout callback in the heap */
      LiteTimeoutFunc            callback;      /* callback called when timeout occurs in event loop */
      void                      *callback_data; /* context data passed to timeout callback */
-     struct _LiteWindowTimeout *next;          /* pointer to the next timeout callback in the queue */
+     struct _LiteWindowTimeout *next;          /* pointer to the next free timeout callback in the pool */
 } LiteWindowTimeout;
 
+/* number of timeout callbacks allocated at once when the pool runs empty */
+#define LITE_TIMEOUT_CHUNK_SIZE 64
+
+typedef struct _LiteTimeoutChunk {
+     struct _LiteTimeoutChunk  *next;          /* pointer to the next chunk of the pool */
+     LiteWindowTimeout          items[LITE_TIMEOUT_CHUNK_SIZE];
+} LiteTimeoutChunk;
+
 typedef struct _LiteWindowIdle {
      int                        id;            /* id value used to remove the idle callback */
      LiteTimeoutFunc            callback;      /* callback called when event loop becomes idle */
      void                      *callback_data; /* context data passed to idle callback */
-     struct _LiteWindowIdle    *next;          /* pointer to the next idle callback in the queue */
+     struct _LiteWindowIdle    *next;          /* pointer to the next idle callback in the queue or in the pool */
+     struct _LiteWindowIdle    *prev;          /* pointer to the previous idle callback in the queue */
 } LiteWindowIdle;
 
+/* number of idle callbacks allocated at once when the pool runs empty */
+#define LITE_IDLE_CHUNK_SIZE 64
+
+typedef struct _LiteIdleChunk {
+     struct _LiteIdleChunk     *next;          /* pointer to the next chunk of the pool */
+     LiteWindowIdle             items[LITE_IDLE_CHUNK_SIZE];
+} LiteIdleChunk;
+
+typedef struct _LiteWindowTask {
+     LiteTimeoutFunc            callback;      /* callback called from the event loop */
+     void                      *callback_data; /* context data passed to the callback */
+     struct _LiteWindowTask    *next;          /* pointer to the next task */
+} LiteWindowTask;
+
+/* event recording file format */
+#define LITE_RECORD_MAGIC   "LiTE-REC"
+#define LITE_RECORD_VERSION 1
+
+typedef enum {
+     LITE_RECORD_EVENT   = 1,                  /* dispatched event, followed by the event data */
+     LITE_RECORD_TIMEOUT = 2,                  /* timeout callback firing */
+     LITE_RECORD_IDLE    = 3,                  /* idle callback firing */
+     LITE_RECORD_TASK    = 4                   /* posted task firing */
+} LiteRecordType;
+
+typedef struct {
+     char                       magic[8];      /* LITE_RECORD_MAGIC */
+     u32                        version;       /* LITE_RECORD_VERSION */
+     u32                        event_size;    /* size of DFBEvent when recording */
+} LiteRecordFileHeader;
+
+typedef struct {
+     u32                        type;          /* LiteRecordType */
+     u32                        size;          /* size of the data following the record */
+     s64                        time;          /* microseconds since the start of the recording */
+} LiteRecordHeader;
+
+/* window events caused by user input */
+#define LITE_INPUT_EVENTS (DWET_KEYDOWN | DWET_KEYUP | DWET_BUTTONDOWN | DWET_BUTTONUP | \
+                           DWET_MOTION | DWET_ENTER | DWET_LEAVE | DWET_WHEEL)
+
+/* maximum number of events taken from the event buffer at once */
+#define LITE_EVENT_BATCH_SIZE 16
+
+/* type of the user event posted by lite_post_task() to wake up the event loop, swallowed by the loop */
+#define LITE_TASK_EVENT_TYPE  0x4c546b73
+
+typedef struct {
+     int                      (*handler)( LiteWindow *window, DFBWindowEvent *event );
+     bool                       enabled_only;  /* handled only by windows that are not disabled */
+} LiteWindowEventHandler;
+
+/* estimated overhead of drawing one more update region, in pixels */
+#define LITE_UPDATE_REGION_COST 4096
+
+/* event loop worklists */
+typedef enum {
+     LITE_WORKLIST_EVENTS  = 0,                /* windows with a pending resize or motion to flush */
+     LITE_WORKLIST_UPDATES = 1                 /* windows with queued update regions to draw */
+} LiteWorklistType;
+
+typedef struct {
+     LiteWindow                *first;         /* first window in the worklist */
+     LiteWindow                *last;          /* last window in the worklist */
+     int                        count;         /* number of windows in the worklist */
+} LiteWorklist;
+
 static IDirectFBEventBuffer  *event_buffer_global   = NULL;
 
 static int                    num_windows_global    = 0;
-static LiteWindow           **window_array_global   = NULL;
+static int                    max_windows_global    = 0;    /* allocated size of the window array */
+static LiteWindow           **window_array_global   = NULL; /* windows in order of creation */
+static DirectHash            *window_ids_global     = NULL; /* window id -> window */
 
 static LiteWindow            *modal_window_global   = NULL;
 static LiteWindow            *entered_window_global = NULL;
@@ -59,18 +142,83 @@ static IDirectFBWindow       *grabbed_window_global = NULL;
 static int                    key_modifier_global   = 0;
 
 static long long              last_update_time      = 0;    /* milliseconds */
-static long long              minimum_update_freq   = 200;  /* milliseconds */
+
+static DFBEvent               event_batch[LITE_EVENT_BATCH_SIZE]; /* events taken from the buffer, shared by nested loops */
+static int                    event_batch_count     = 0;
+static int                    event_batch_next      = 0;
+
+static LiteWindowEventHandler event_handlers[LITE_WINDOW_EVENT_TYPES];
+static bool                   event_handlers_inited = false;
+
+static DirectFile             record_file;
+static bool                   record_active         = false;
+static long long              record_start          = 0;    /* microseconds */
+
+static DirectFile             replay_file;
+static bool                   replay_active         = false;
+static bool                   replay_pending        = false; /* next input event loaded */
+static long long              replay_start          = 0;    /* virtual time of the start of the recording */
+static long long              replay_clock          = 0;    /* virtual clock in microseconds */
+static LiteRecordHeader       replay_header;
+static DFBEvent               replay_event;
+static unsigned int           replay_recorded[5];           /* records per type read from the recording */
+static unsigned int           replay_fired[5];              /* records per type fired during the replay */
+static unsigned int           replay_inputs;                /* recorded input events read from the recording */
+
+static unsigned int           window_serial_next    = 0;
+
+static long long              input_origin          = 0;    /* time of the input event being handled, 0 if none */
+
+static int                    transaction_depth     = 0;    /* nesting of lite_begin_update() for all windows, atomic */
+
+static LiteWindowTask        *task_stack           = NULL; /* posted tasks, most recent first, pushed lock-free */
+static LiteWindowTask        *task_queue           = NULL; /* tasks taken by the event loop, in posting order */
+
+static LiteWindow            *cleanup_list         = NULL; /* destroyed windows whose resources are released by the loop */
+
+static LiteFrameStats         frame_stats;
+static bool                   frame_scheduled       = false;
+static long long              frame_deadline        = 0;    /* microseconds */
+static long long              frame_last_start      = 0;    /* microseconds */
 
 static DirectMutex            timeout_mutex         = DIRECT_MUTEX_INITIALIZER();
-static LiteWindowTimeout     *timeout_queue         = NULL;
+static LiteWindowTimeout    **timeout_heap          = NULL; /* binary min-heap ordered by trigger time */
+static int                    timeout_count         = 0;
+static int                    timeout_capacity      = 0;
+static DirectHash            *timeout_ids           = NULL; /* timeout id -> timeout callback */
+static LiteWindowTimeout     *timeout_free          = NULL;
+static LiteTimeoutChunk      *timeout_chunks        = NULL;
+static long long              timeout_next_serial   = 0;
 static int                    timeout_next_id       = 1;
 
 static DirectMutex            idle_mutex            = DIRECT_MUTEX_INITIALIZER();
 static LiteWindowIdle        *idle_queue            = NULL;
+static LiteWindowIdle        *idle_tail             = NULL;
+static DirectHash            *idle_ids              = NULL; /* idle id -> idle callback */
+static LiteWindowIdle        *idle_free             = NULL;
+static LiteIdleChunk         *idle_chunks           = NULL;
 static int                    idle_next_id          = 1;
 
 static bool                   event_loop_alive      = false;
 
+static DirectMutex            worklist_mutex        = DIRECT_MUTEX_INITIALIZER();
+static LiteWorklist           worklists[2];
+
+static void      register_window  ( LiteWindow *window );
+static bool      unregister_window( LiteWindow *window );
+
+static void        worklist_add   ( LiteWorklistType type, LiteWindow *window );
+static LiteWindow *worklist_pop   ( LiteWorklistType type );
+static int         worklist_count ( LiteWorklistType type );
+static void        worklist_remove( LiteWorklistType type, LiteWindow *window );
+
+static void      damage_add( LiteWindow *window, const DFBRegion *update );
+static void      dirty_add ( LiteWindow *window, const DFBRegion *update, LiteBox *floor );
+
+/* collect and submit areas of a transaction, called with the update lock of the window */
+static void      transaction_add   ( LiteWindow *window, const DFBRegion *update, LiteBox *floor );
+static bool      transaction_submit( LiteWindow *window );
+
 static DFBResult draw_window( LiteBox *box, const DFBRegion *region, DFBBoolean clear );
 
 static void      render_title ( LiteWindow *window );
@@ -80,6 +228,8 @@ static int       handle_move      ( LiteWindow *window, DFBWindowEvent *ev );
 static int       handle_resize    ( LiteWindow *window, DFBWindowEvent *ev );
 static int       handle_close     ( LiteWindow *window );
 static int       handle_destroy   ( LiteWindow *window );
+static void      drop_events      ( LiteWindow *window );
+static void      cleanup_windows  ( void );
 static int       handle_got_focus ( LiteWindow *window );
 static int       handle_lost_focus( LiteWindow *window );
 static int       handle_enter     ( LiteWindow *window, DFBWindowEvent *ev );
@@ -90,6 +240,18 @@ static int       handle_key_up    ( LiteWindow *window, DFBWindowEvent *ev );
 static int       handle_key_down  ( LiteWindow *window, DFBWindowEvent *ev );
 static int       handle_wheel     ( LiteWindow *window, DFBWindowEvent *ev );
 
+static int       dispatch_size         ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_position_size( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_close        ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_got_focus    ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_lost_focus   ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_enter        ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_motion       ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_button       ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_key_up       ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_key_down     ( LiteWindow *window, DFBWindowEvent *ev );
+static int       dispatch_wheel        ( LiteWindow *window, DFBWindowEvent *ev );
+
 /**********************************************************************************************************************/
 
 DFBResult
@@ -124,6 +286,7 @@ lite_new_window( IDirectFBDisplayLayer  *layer,
      }
 
      window->box.type       = LITE_TYPE_WINDOW;
+     window->box.window     = window;
      window->box.is_visible = 1;
      window->box.is_active  = 1;
      window->box.Draw       = draw_window;
@@ -142,7 +305,7 @@ lite_new_window( IDirectFBDisplayLayer  *layer,
      desc.flags  = DWDESC_POSX | DWDESC_POSY | DWDESC_WIDTH | DWDESC_HEIGHT | DWDESC_CAPS;
      desc.width  = window->box.rect.w;
      desc.height = window->box.rect.h;
-     desc.caps   = getenv( "LITE_WINDOW_DOUBLEBUFFER" ) ? caps | DWCAPS_DOUBLEBUFFER : caps;
+     desc.caps   = lite_config.window_doublebuffer ? caps | DWCAPS_DOUBLEBUFFER : caps;
 
      if (theme != liteNoWindowTheme) {
           desc.width  += (theme->frame.parts[LITE_THEME_FRAME_PART_LEFT].rect.w +
@@ -291,10 +454,8 @@ lite_new_window( IDirectFBDisplayLayer  *layer,
      /* initial update */
      lite_update_box( LITE_BOX(window), NULL );
 
-     /* add the window to the global linked list of windows */
-     num_windows_global++;
-     window_array_global = D_REALLOC( window_array_global, num_windows_global * sizeof(LiteWindow*) );
-     window_array_global[num_windows_global - 1] = window;
+     /* add the window to the global list of windows */
+     register_window( window );
 
      *ret_window = window;
 
@@ -363,21 +524,17 @@ find_child( LiteBox *box,
             int     *x,
             int     *y )
 {
-     int i;
+     LiteBox *child;
 
-search_again:
-     if (box->catches_all_events)
-          return box;
-
-     for (i = box->n_children - 1; i >= 0; i--) {
-          LiteBox *child = box->children[i];
+     /* descend into the topmost child under the point until a leaf or a box catching all events is reached */
+     while (!box->catches_all_events) {
+          child = prvlite_box_child_at( box, *x, *y );
+          if (!child)
+               break;
 
-          if (child->is_visible && DFB_RECTANGLE_CONTAINS_POINT( &child->rect, *x, *y )) {
-               *x -= child->rect.x;
-               *y -= child->rect.y;
-               box = child;
-               goto search_again;
-          }
+          *x -= child->rect.x;
+          *y -= child->rect.y;
+          box = child;
      }
 
      return box;
@@ -470,16 +627,145 @@ lite_window_set_modal( LiteWindow *window,
      return DFB_OK;
 }
 
+/* input to present latency */
+
+/* monotonic time of an input event, from its timestamp when plausible, otherwise from now */
+static long long
+event_origin( const DFBWindowEvent *event )
+{
+     long long now = direct_clock_get_micros();
+
+     if (event->timestamp.tv_sec) {
+          long long age = direct_clock_get_abs_micros() -
+                          (event->timestamp.tv_sec * 1000000LL + event->timestamp.tv_usec);
+
+          if (age > 0 && age < 10000000)
+               return now - age;
+     }
+
+     return now;
+}
+
+/* log-linear bucket of a latency, exact below 32 us, within 1/16 above */
+static int
+latency_bucket( long long value )
+{
+     int msb = 0;
+
+     if (value < 32)
+          return MAX( value, 0 );
+
+     if (value >= (1LL << 31))
+          return LITE_LATENCY_BUCKETS - 1;
+
+     while (value >> (msb + 1))
+          msb++;
+
+     return (msb - 3) * 16 + ((value >> (msb - 4)) & 15);
+}
+
+/* highest latency falling into a bucket */
+static long long
+latency_bucket_value( int bucket )
+{
+     int shift;
+
+     if (bucket < 32)
+          return bucket;
+
+     shift = bucket / 16 - 1;
+
+     return ((16LL + bucket % 16) << shift) + (1LL << shift) - 1;
+}
+
+/* must be called with the updates lock held */
+static void
+latency_present( LiteWindow *window )
+{
+     long long latency;
+
+     if (!window->updates.input_origin)
+          return;
+
+     latency = direct_clock_get_micros() - window->updates.input_origin;
+
+     window->updates.input_origin = 0;
+
+     if (!window->latency.buckets)
+          window->latency.buckets = D_CALLOC( LITE_LATENCY_BUCKETS, sizeof(u32) );
+
+     window->latency.buckets[latency_bucket( latency )]++;
+     window->latency.count++;
+
+     if (window->latency.max < latency)
+          window->latency.max = latency;
+
+     D_DEBUG_AT( LiteUpdateDomain, "  -> input to present latency %lld us\n", latency );
+}
+
+static long long
+latency_percentile( const LiteWindow *window,
+                    int               percent )
+{
+     int          i;
+     unsigned int seen = 0;
+     unsigned int rank = (window->latency.count * (unsigned long long) percent + 99) / 100;
+
+     for (i = 0; i < LITE_LATENCY_BUCKETS; i++) {
+          seen += window->latency.buckets[i];
+
+          if (seen >= rank)
+               return MIN( latency_bucket_value( i ), window->latency.max );
+     }
+
+     return window->latency.max;
+}
+
+static void
+latency_dump( LiteWindow *window )
+{
+     if (!window->latency.count)
+          return;
+
+     D_INFO( "LiTE/Window: Window %u '%s' input to present latency: %u samples, "
+             "p50 %lld us, p95 %lld us, p99 %lld us, max %lld us\n",
+             window->serial, window->title ? window->title : "", window->latency.count,
+             latency_percentile( window, 50 ), latency_percentile( window, 95 ), latency_percentile( window, 99 ),
+             window->latency.max );
+}
+
+static inline long long
+region_area( const DFBRegion *region )
+{
+     return (long long) (region->x2 - region->x1 + 1) * (region->y2 - region->y1 + 1);
+}
+
+/* event loop clock, virtual while replaying a recording */
+static inline long long
+loop_clock_micros( void )
+{
+     return replay_active ? replay_clock : direct_clock_get_micros();
+}
+
+static inline long long
+loop_clock_millis( void )
+{
+     return loop_clock_micros() / 1000;
+}
+
 static void
 draw_updated_windows( void )
 {
-     int i, n;
+     int         i, n;
+     LiteWindow *window;
 
      D_DEBUG_AT( LiteUpdateDomain, "%s()\n", __FUNCTION__ );
 
-     for (n = 0; n < num_windows_global; n++) {
-          int         pending;
-          LiteWindow *window = window_array_global[n];
+     /* only visit windows with queued updates, windows updated while drawing are handled in the next pass */
+     n = worklist_count( LITE_WORKLIST_UPDATES );
+
+     while (n-- > 0 && (window = worklist_pop( LITE_WORKLIST_UPDATES )) != NULL) {
+          int pending;
 
           if (window->flags & LITE_WINDOW_DESTROYED)
                continue;
@@ -490,7 +776,23 @@ draw_updated_windows( void )
           if (pending) {
                D_DEBUG_AT( LiteUpdateDomain, "  -> updating window %u (%p)\n", window->id, window );
 
-               if (getenv( "LITE_BOUNDING_UPDATES" )) {
+               if (window->updates.num_dirty > 0 && window->updates.dirty_serial == prvlite_box_geometry_serial()) {
+                    /* draw the dirty areas only, each from the opaque box that caused it upwards */
+                    for (i = 0; i < window->updates.num_dirty; i++) {
+                         DFBRegion region = window->updates.dirty[i].region;
+
+                         D_DEBUG_AT( LiteUpdateDomain, "  -> " DFB_RECT_FORMAT " (dirty area from %p)\n",
+                                     DFB_RECTANGLE_VALS_FROM_REGION( &region ), window->updates.dirty[i].floor );
+
+                         window->updates.stats.drawn_pixels += region_area( &region );
+                         window->updates.stats.regions++;
+
+                         prvlite_draw_dirty_area( window, &region, window->updates.dirty[i].floor );
+                    }
+
+                    window->updates.pending = 0;
+               }
+               else if (lite_config.bounding_updates) {
                     DFBRegion bounding;
 
                     dfb_regions_unite( &bounding, window->updates.regions, window->updates.pending );
@@ -500,6 +802,9 @@ draw_updated_windows( void )
 
                     window->updates.pending = 0;
 
+                    window->updates.stats.drawn_pixels += region_area( &bounding );
+                    window->updates.stats.regions++;
+
                     lite_draw_box( LITE_BOX(window), &bounding, DFB_TRUE );
                }
                else {
@@ -513,10 +818,17 @@ draw_updated_windows( void )
                          D_DEBUG_AT( LiteUpdateDomain, "  -> " DFB_RECT_FORMAT " (%d regions pending)\n",
                                      DFB_RECTANGLE_VALS_FROM_REGION( &region ), window->updates.pending );
 
+                         window->updates.stats.drawn_pixels += region_area( &region );
+                         window->updates.stats.regions++;
+
                          lite_draw_box( LITE_BOX(window), &region, DFB_TRUE );
                     }
                }
 
+               window->updates.num_dirty = 0;
+
+               latency_present( window );
+
                /* apply opacity change */
                if (!(window->flags & LITE_WINDOW_DRAWN)) {
                     window->flags |= LITE_WINDOW_DRAWN;
@@ -528,214 +840,858 @@ draw_updated_windows( void )
           direct_mutex_unlock( &window->updates.lock );
      }
 
-     last_update_time = direct_clock_get_millis();
+     last_update_time = loop_clock_millis();
 }
 
 static LiteWindow *
 find_window_by_id( DFBWindowID id )
+{
+     if (!window_ids_global)
+          return NULL;
+
+     return direct_hash_lookup( window_ids_global, id );
+}
+
+/* event recording and replay */
+
+static bool
+is_input_event( const DFBEvent *event )
+{
+     if (event->clazz != DFEC_WINDOW)
+          return false;
+
+     return (event->window.type & LITE_INPUT_EVENTS) != 0;
+}
+
+static LiteWindow *
+find_window_by_serial( unsigned int serial )
 {
      int n;
 
-     for (n = 0; n < num_windows_global; n++)
-          if (window_array_global[n]->id == id)
+     for (n = 0; n < num_windows_global; n++) {
+          if (window_array_global[n]->serial == serial)
                return window_array_global[n];
+     }
 
      return NULL;
 }
 
-static DFBResult
-get_time_until_next_timeout( long long *remaining )
+static void
+record_write( LiteRecordType  type,
+              const void     *data,
+              u32             size )
 {
-     DFBResult ret = DFB_FAILURE;
+     DirectResult     ret;
+     LiteRecordHeader header;
 
-     direct_mutex_lock( &timeout_mutex );
-
-     if (timeout_queue) {
-          long long now = direct_clock_get_millis();
+     header.type = type;
+     header.size = size;
+     header.time = loop_clock_micros() - record_start;
 
-          *remaining = timeout_queue->timeout - now;
+     ret = direct_file_write( &record_file, &header, sizeof(header), NULL );
+     if (!ret && size)
+          ret = direct_file_write( &record_file, data, size, NULL );
 
-          ret = DFB_OK;
+     if (ret) {
+          D_DERROR( ret, "LiTE/Window: Could not write event recording, stopping!\n" );
+          lite_record_events( NULL );
      }
-
-     direct_mutex_unlock( &timeout_mutex );
-
-     return ret;
 }
 
-static DFBResult
-remove_next_timeout_callback( LiteTimeoutFunc  *callback,
-                              void            **callback_data )
+static void
+record_event( const DFBEvent *event )
 {
-     DFBResult ret = DFB_FAILURE;
+     u32 size;
 
-     direct_mutex_lock( &timeout_mutex );
+     if (!record_active)
+          return;
 
-     long long now = direct_clock_get_millis();
+     switch (event->clazz) {
+          case DFEC_WINDOW: {
+               DFBWindowEvent  window_event = event->window;
+               LiteWindow     *window       = find_window_by_id( window_event.window_id );
 
-     if (timeout_queue && timeout_queue->timeout <= now) {
-          LiteWindowTimeout *node = timeout_queue;
+               if (!window)
+                    return;
 
-          *callback      = node->callback;
-          *callback_data = node->callback_data;
+               /* window ids may differ between runs, use the creation order instead */
+               window_event.window_id = window->serial;
 
-          timeout_queue = node->next;
+               record_write( LITE_RECORD_EVENT, &window_event, sizeof(DFBWindowEvent) );
+               return;
+          }
 
-          D_FREE( node );
+          case DFEC_USER:
+               size = sizeof(DFBUserEvent);
+               break;
 
-          ret = DFB_OK;
+          case DFEC_UNIVERSAL:
+               size = event->universal.size;
+               break;
+
+          default:
+               size = sizeof(DFBEvent);
+               break;
      }
 
-     direct_mutex_unlock( &timeout_mutex );
+     record_write( LITE_RECORD_EVENT, event, MIN( size, sizeof(DFBEvent) ) );
+}
 
-     return ret;
+static void
+record_firing( LiteRecordType type )
+{
+     if (replay_active)
+          replay_fired[type]++;
+
+     if (record_active)
+          record_write( type, NULL, 0 );
 }
 
-static DFBResult
-remove_top_idle_callback( LiteTimeoutFunc  *callback,
-                          void            **callback_data )
+static bool
+replay_read( void   *data,
+             size_t  size )
 {
-     DFBResult ret = DFB_FAILURE;
+     size_t bytes = 0;
 
-     direct_mutex_lock( &idle_mutex );
+     return !direct_file_read( &replay_file, data, size, &bytes ) && bytes == size;
+}
 
-     if (idle_queue) {
-          LiteWindowIdle *node = idle_queue;
+/* read up to the next recorded input event, counting the other records */
+static void
+replay_load_next( void )
+{
+     replay_pending = false;
 
-          *callback      = node->callback;
-          *callback_data = node->callback_data;
+     while (replay_read( &replay_header, sizeof(replay_header) )) {
+          if (replay_header.size > sizeof(DFBEvent) || replay_header.type < LITE_RECORD_EVENT ||
+              replay_header.type > LITE_RECORD_TASK) {
+               D_ERROR( "LiTE/Window: Invalid record in event recording!\n" );
+               return;
+          }
 
-          idle_queue = node->next;
+          replay_recorded[replay_header.type]++;
 
-          D_FREE( node );
+          if (!replay_header.size)
+               continue;
 
-          ret = DFB_OK;
-     }
+          memset( &replay_event, 0, sizeof(replay_event) );
 
-     direct_mutex_unlock(&idle_mutex);
+          if (!replay_read( &replay_event, replay_header.size ))
+               return;
 
-     return ret;
+          if (is_input_event( &replay_event )) {
+               replay_inputs++;
+               replay_pending = true;
+               return;
+          }
+     }
 }
 
-DFBResult
-lite_window_event_loop( LiteWindow *window,
-                        int         timeout )
+static bool
+replay_next_event( DFBEvent *ret_event )
 {
-     DFBResult        ret;
-     LiteTimeoutFunc  callback;
-     void            *callback_data;
-     long long        remaining;
-     int              timeout_id           = 0;
-     bool             handle_window_events = true;
+     while (replay_pending && replay_start + replay_header.time <= replay_clock) {
+          LiteWindow *window = find_window_by_serial( replay_event.window.window_id );
 
-     LITE_NULL_PARAMETER_CHECK( window );
-     LITE_WINDOW_PARAMETER_CHECK( window );
+          *ret_event = replay_event;
 
-     D_DEBUG_AT( LiteWindowDomain, "Enter window event loop with timeout: %d\n", timeout );
+          replay_fired[LITE_RECORD_EVENT]++;
 
-     event_loop_alive = true;
+          replay_load_next();
 
-     /* destroy window only when event loop ends */
-     ++window->internal_ref_count;
+          /* events for windows that don't exist in this run are dropped */
+          if (window) {
+               ret_event->window.window_id = window->id;
+               return true;
+          }
+     }
 
-     /* add stop timeout */
-     if (timeout > 0)
-          lite_enqueue_timeout_callback( timeout, NULL, NULL, &timeout_id );
+     return false;
+}
 
-     while (true) {
-          /* first test if the alive flag is still set, otherwise exit immediately */
-          if (event_loop_alive == false) {
-               ret = DFB_OK;
-               break;
-          }
+static void
+replay_finish( void )
+{
+     long long delta = direct_clock_get_micros() - replay_clock;
 
-          if (direct_clock_get_millis() - last_update_time >= minimum_update_freq) {
-              /* always flush window-specific events after processing all events */
-              lite_flush_window_events( NULL );
+     /* read the rest of the recording for the totals */
+     while (replay_pending)
+          replay_load_next();
 
-              /* redraw all windows that have been changed due to events */
-              draw_updated_windows();
-          }
+     D_INFO( "LiTE/Window: Replay finished: %u/%u input events, %u/%u timeouts, %u/%u idle callbacks, %u/%u tasks\n",
+             replay_fired[LITE_RECORD_EVENT], replay_inputs,
+             replay_fired[LITE_RECORD_TIMEOUT], replay_recorded[LITE_RECORD_TIMEOUT],
+             replay_fired[LITE_RECORD_IDLE], replay_recorded[LITE_RECORD_IDLE],
+             replay_fired[LITE_RECORD_TASK], replay_recorded[LITE_RECORD_TASK] );
 
-          ret = event_buffer_global->HasEvent( event_buffer_global );
-          if (ret == DFB_OK) {
-               DFBEvent evt;
+     direct_file_close( &replay_file );
 
-               /* get the event, dispatch it to the window-specific event handler */
-               ret = event_buffer_global->GetEvent( event_buffer_global, &evt );
-               if (ret != DFB_OK)
-                    continue;
+     replay_active  = false;
+     replay_pending = false;
 
-               if (evt.clazz == DFEC_USER) {
-                    if (window->user_event_func)
-                         window->user_event_func( (DFBUserEvent*) &evt, window->user_event_data );
-               }
-               else if (evt.clazz == DFEC_UNIVERSAL) {
-                    if (window->universal_event_func)
-                         window->universal_event_func( (DFBUniversalEvent*) &evt, window->universal_event_data );
-               }
-               else if (evt.clazz == DFEC_WINDOW) {
-                    DFBWindowEvent *win_event = (DFBWindowEvent*) &evt;
+     /* the virtual clock ran ahead of real time, move what was scheduled on it to real time */
+     lite_rebase_window_timeouts( delta / 1000 );
 
-                    /* if we have a window event callback, the event is intercepted and can be handled */
-                    if (window->window_event_func) {
-                        ret = window->window_event_func( win_event, window->window_event_data );
-                        if (ret != DFB_OK) {
-                            /* the window event callback indicates that the event is handled and should no longer be
-                               processed */
-                            handle_window_events = false;
-                        }
-                    }
+     frame_deadline   += delta;
+     frame_last_start += delta;
+     last_update_time += delta / 1000;
+     record_start     += delta;
+}
 
-                    /* process the event unles a possible window event callback indicates that it was handled */
-                    if (handle_window_events == true) {
-                         int result = lite_handle_window_event( find_window_by_id( win_event->window_id ), win_event );
+/* advance the virtual clock to the next recorded event, or earlier timeout or frame, returns false when finished */
+static bool
+replay_advance_clock( long long remaining )
+{
+     long long target;
 
-                         /* the last window is destroyed or closed, or the current window is destroyed */
-                         if (win_event->type == DWET_DESTROYED || result < 0) {
-                              if (num_windows_global == 0 || window->id == win_event->window_id) {
-                                   ret = DFB_DESTROYED;
-                                   break;
-                              }
-                         }
-                         else if (win_event->type == DWET_CLOSE) {
-                              if (num_windows_global == 1) {
-                                   lite_destroy_window( window );
-                                   ret = DFB_DESTROYED;
-                                   break;
-                              }
-                         }
-                    }
-               }
+     if (!replay_pending) {
+          replay_finish();
+          return false;
+     }
 
-               continue;
-          }
+     target = replay_start + replay_header.time;
 
-          /* always flush window-specific events after processing all events */
-          lite_flush_window_events( NULL );
+     if (remaining >= 0 && replay_clock + remaining * 1000 < target)
+          target = replay_clock + remaining * 1000;
 
-          /* redraw any windows that have been changed due to events */
-          draw_updated_windows();
+     replay_clock = MAX( replay_clock, target );
 
-          /* now check timeout callbacks */
-          ret = remove_next_timeout_callback( &callback, &callback_data );
-          if (ret == DFB_OK) {
-               if (callback) {
-                    ret = callback( callback_data );
-                    if (ret != DFB_OK)
-                         break;
-               }
-               else {
-                    ret = DFB_TIMEOUT;
-                    break;
-               }
+     return true;
+}
 
-               continue;
+static DFBResult
+run_posted_tasks( void )
+{
+     DFBResult       ret = DFB_OK;
+     LiteWindowTask *task;
+
+     if (!task_queue && task_stack) {
+          /* take all posted tasks at once and restore the posting order */
+          do {
+               task = task_stack;
+          } while (!D_SYNC_BOOL_COMPARE_AND_SWAP( &task_stack, task, NULL ));
+
+          while (task) {
+               LiteWindowTask *next = task->next;
+
+               task->next = task_queue;
+               task_queue = task;
+               task       = next;
           }
+     }
 
-          /* now check idle callbacks */
+     /* tasks left after a failing one are run in the next iteration */
+     while (task_queue && ret == DFB_OK) {
+          task       = task_queue;
+          task_queue = task->next;
+
+          record_firing( LITE_RECORD_TASK );
+
+          ret = task->callback( task->callback_data );
+
+          D_FREE( task );
+     }
+
+     return ret;
+}
+
+/* index of an event type in the dispatch tables: the lowest bit set, or the last entry for DWET_POSITION_SIZE */
+static inline int
+event_type_index( DFBWindowEventType type )
+{
+     int index = 0;
+
+     if (type == DWET_POSITION_SIZE)
+          return LITE_WINDOW_EVENT_TYPES - 1;
+
+     if (!type)
+          return 0;
+
+#ifdef __GNUC__
+     index = __builtin_ctz( type );
+#else
+     while (!(type & (1 << index)))
+          index++;
+#endif
+
+     return MIN( index, LITE_WINDOW_EVENT_TYPES - 1 );
+}
+
+static void
+set_raw_handler( LiteWindow          *window,
+                 DFBWindowEventType   type,
+                 LiteWindowEventFunc  callback,
+                 void                *data )
+{
+     int index = event_type_index( type );
+
+     window->raw_handlers[index].func = callback;
+     window->raw_handlers[index].data = data;
+}
+
+static void
+set_event_handler( DFBWindowEventType   type,
+                   int                (*handler)( LiteWindow *window, DFBWindowEvent *event ),
+                   bool                 enabled_only )
+{
+     int index = event_type_index( type );
+
+     event_handlers[index].handler      = handler;
+     event_handlers[index].enabled_only = enabled_only;
+}
+
+static void
+init_event_handlers( void )
+{
+     /* events handled by all windows */
+     set_event_handler( DWET_POSITION,      handle_move,            false );
+     set_event_handler( DWET_SIZE,          dispatch_size,          false );
+     set_event_handler( DWET_POSITION_SIZE, dispatch_position_size, false );
+     set_event_handler( DWET_CLOSE,         dispatch_close,         false );
+     set_event_handler( DWET_LOSTFOCUS,     dispatch_lost_focus,    false );
+     set_event_handler( DWET_GOTFOCUS,      dispatch_got_focus,     false );
+
+     /* events handled by enabled windows */
+     set_event_handler( DWET_ENTER,         dispatch_enter,         true );
+     set_event_handler( DWET_LEAVE,         handle_leave,           true );
+     set_event_handler( DWET_MOTION,        dispatch_motion,        true );
+     set_event_handler( DWET_BUTTONUP,      dispatch_button,        true );
+     set_event_handler( DWET_BUTTONDOWN,    dispatch_button,        true );
+     set_event_handler( DWET_KEYUP,         dispatch_key_up,        true );
+     set_event_handler( DWET_KEYDOWN,       dispatch_key_down,      true );
+     set_event_handler( DWET_WHEEL,         dispatch_wheel,         true );
+
+     event_handlers_inited = true;
+}
+
+/* merge an event into the previous one when only the last state matters, returns true if merged */
+static bool
+compact_event( DFBEvent       *prev,
+               const DFBEvent *event )
+{
+     const DFBWindowEvent *ev = &event->window;
+     DFBWindowEvent       *pv = &prev->window;
+
+     if (prev->clazz != DFEC_WINDOW || event->clazz != DFEC_WINDOW)
+          return false;
+
+     if (pv->window_id != ev->window_id || pv->type != ev->type)
+          return false;
+
+     switch (ev->type) {
+          case DWET_MOTION:
+               /* keep the last position unless the button or modifier state changed */
+               if (pv->buttons != ev->buttons || pv->modifiers != ev->modifiers)
+                    return false;
+
+               *pv = *ev;
+               break;
+
+          case DWET_POSITION:
+               *pv = *ev;
+               break;
+
+          case DWET_WHEEL: {
+               int step = pv->step + ev->step;
+
+               if (pv->modifiers != ev->modifiers)
+                    return false;
+
+               *pv      = *ev;
+               pv->step = step;
+               break;
+          }
+
+          default:
+               return false;
+     }
+
+     D_DEBUG_AT( LiteMotionDomain, "  -> compacted event 0x%08x for window %u\n", ev->type, ev->window_id );
+
+     return true;
+}
+
+static DFBResult
+next_batched_event( DFBEvent *ret_event )
+{
+     /* recorded input events are dispatched in place of live ones when they are due */
+     if (replay_active && replay_next_event( ret_event )) {
+          record_event( ret_event );
+          return DFB_OK;
+     }
+
+     if (event_batch_next == event_batch_count) {
+          event_batch_next  = 0;
+          event_batch_count = 0;
+
+          while (event_batch_count < LITE_EVENT_BATCH_SIZE) {
+               DFBEvent *event = &event_batch[event_batch_count];
+
+               if (event_buffer_global->GetEvent( event_buffer_global, event ) != DFB_OK)
+                    break;
+
+               /* live input is ignored while replaying */
+               if (replay_active && is_input_event( event ))
+                    continue;
+
+               /* posted tasks are taken at the top of the event loop */
+               if (event->clazz == DFEC_USER && event->user.type == LITE_TASK_EVENT_TYPE &&
+                   event->user.data == &task_stack)
+                    continue;
+
+               if (event_batch_count && compact_event( &event_batch[event_batch_count - 1], event ))
+                    continue;
+
+               event_batch_count++;
+          }
+
+          if (!event_batch_count)
+               return DFB_BUFFEREMPTY;
+
+          D_DEBUG_AT( LiteWindowDomain, "  -> %d events taken\n", event_batch_count );
+     }
+
+     /* copy the event, a nested event loop may refill the batch while it is dispatched */
+     *ret_event = event_batch[event_batch_next++];
+
+     record_event( ret_event );
+
+     return DFB_OK;
+}
+
+static bool
+frame_due( void )
+{
+     long long now;
+     long long period = 1000000 / lite_config.frame_rate;
+
+     if (!frame_scheduled) {
+          if (!worklist_count( LITE_WORKLIST_UPDATES ) && !worklist_count( LITE_WORKLIST_EVENTS ))
+               return false;
+
+          now = loop_clock_micros();
+
+          /* schedule the frame one period after the previous one, or right now after an idle period */
+          frame_scheduled = true;
+          frame_deadline  = MAX( now, frame_last_start + period );
+
+          D_DEBUG_AT( LiteUpdateDomain, "  -> frame scheduled in %lld us\n", frame_deadline - now );
+
+          return frame_deadline <= now;
+     }
+
+     return frame_deadline <= loop_clock_micros();
+}
+
+static void
+draw_frame( void )
+{
+     long long start, end, duration;
+     long long now;
+
+     start = direct_clock_get_micros();
+
+     /* always flush window-specific events after processing all events */
+     lite_flush_window_events( NULL );
+
+     if (!worklist_count( LITE_WORKLIST_UPDATES )) {
+          /* nothing to draw, but the minimum update interval starts again */
+          last_update_time = loop_clock_millis();
+
+          frame_scheduled = false;
+          return;
+     }
+
+     if (lite_config.wait_for_sync && lite_layer)
+          lite_layer->WaitForSync( lite_layer );
+
+     /* redraw all windows that have been changed due to events */
+     draw_updated_windows();
+
+     end      = direct_clock_get_micros();
+     duration = end - start;
+     now      = loop_clock_micros();
+
+     frame_stats.frames++;
+     frame_stats.last_frame_time   = duration;
+     frame_stats.total_frame_time += duration;
+
+     if (frame_stats.max_frame_time < duration)
+          frame_stats.max_frame_time = duration;
+
+     if (frame_scheduled && lite_config.frame_rate > 0) {
+          long long period = 1000000 / lite_config.frame_rate;
+
+          /* frame periods elapsed between the deadline and the end of drawing, beyond the frame's own period */
+          frame_stats.missed_frames += MAX( now - frame_deadline, 0 ) / period;
+
+          frame_last_start = MAX( now - duration, frame_deadline );
+     }
+
+     frame_scheduled = false;
+
+     D_DEBUG_AT( LiteUpdateDomain, "  -> frame %u drawn in %lld us\n", frame_stats.frames, duration );
+}
+
+/* timeout heap helpers, must be called with timeout_mutex held */
+
+static bool
+timeout_before( const LiteWindowTimeout *a,
+                const LiteWindowTimeout *b )
+{
+     if (a->timeout != b->timeout)
+          return a->timeout < b->timeout;
+
+     return a->serial < b->serial;
+}
+
+static void
+timeout_heap_set( int                index,
+                  LiteWindowTimeout *item )
+{
+     timeout_heap[index] = item;
+     item->index         = index;
+}
+
+static void
+timeout_heap_up( int index )
+{
+     LiteWindowTimeout *item = timeout_heap[index];
+
+     while (index > 0) {
+          int parent = (index - 1) / 2;
+
+          if (!timeout_before( item, timeout_heap[parent] ))
+               break;
+
+          timeout_heap_set( index, timeout_heap[parent] );
+
+          index = parent;
+     }
+
+     timeout_heap_set( index, item );
+}
+
+static void
+timeout_heap_down( int index )
+{
+     LiteWindowTimeout *item = timeout_heap[index];
+
+     while (true) {
+          int child = 2 * index + 1;
+
+          if (child >= timeout_count)
+               break;
+
+          if (child + 1 < timeout_count && timeout_before( timeout_heap[child+1], timeout_heap[child] ))
+               child++;
+
+          if (!timeout_before( timeout_heap[child], item ))
+               break;
+
+          timeout_heap_set( index, timeout_heap[child] );
+
+          index = child;
+     }
+
+     timeout_heap_set( index, item );
+}
+
+static LiteWindowTimeout *
+timeout_alloc( void )
+{
+     LiteWindowTimeout *item;
+
+     /* refill the pool with a new chunk of timeout callbacks */
+     if (!timeout_free) {
+          int               i;
+          LiteTimeoutChunk *chunk = D_CALLOC( 1, sizeof(LiteTimeoutChunk) );
+
+          chunk->next    = timeout_chunks;
+          timeout_chunks = chunk;
+
+          for (i = LITE_TIMEOUT_CHUNK_SIZE - 1; i >= 0; i--) {
+               chunk->items[i].next = timeout_free;
+               timeout_free         = &chunk->items[i];
+          }
+     }
+
+     item         = timeout_free;
+     timeout_free = item->next;
+
+     return item;
+}
+
+static void
+timeout_remove( LiteWindowTimeout *item )
+{
+     int                index = item->index;
+     LiteWindowTimeout *last  = timeout_heap[--timeout_count];
+
+     direct_hash_remove( timeout_ids, item->id );
+
+     /* move the last timeout callback into the hole and restore the heap order */
+     if (last != item) {
+          timeout_heap_set( index, last );
+
+          if (index > 0 && timeout_before( last, timeout_heap[(index - 1) / 2] ))
+               timeout_heap_up( index );
+          else
+               timeout_heap_down( index );
+     }
+
+     /* give the timeout callback back to the pool */
+     item->next   = timeout_free;
+     timeout_free = item;
+}
+
+static DFBResult
+get_time_until_next_timeout( long long *remaining )
+{
+     DFBResult ret = DFB_FAILURE;
+
+     direct_mutex_lock( &timeout_mutex );
+
+     if (timeout_count) {
+          long long now = loop_clock_millis();
+
+          *remaining = timeout_heap[0]->timeout - now;
+
+          ret = DFB_OK;
+     }
+
+     direct_mutex_unlock( &timeout_mutex );
+
+     return ret;
+}
+
+static DFBResult
+remove_next_timeout_callback( LiteTimeoutFunc  *callback,
+                              void            **callback_data )
+{
+     DFBResult ret = DFB_FAILURE;
+
+     direct_mutex_lock( &timeout_mutex );
+
+     long long now = loop_clock_millis();
+
+     if (timeout_count && timeout_heap[0]->timeout <= now) {
+          LiteWindowTimeout *node = timeout_heap[0];
+
+          *callback      = node->callback;
+          *callback_data = node->callback_data;
+
+          timeout_remove( node );
+
+          ret = DFB_OK;
+     }
+
+     direct_mutex_unlock( &timeout_mutex );
+
+     return ret;
+}
+
+/* idle queue helpers, must be called with idle_mutex held */
+
+static LiteWindowIdle *
+idle_alloc( void )
+{
+     LiteWindowIdle *item;
+
+     /* refill the pool with a new chunk of idle callbacks */
+     if (!idle_free) {
+          int            i;
+          LiteIdleChunk *chunk = D_CALLOC( 1, sizeof(LiteIdleChunk) );
+
+          chunk->next = idle_chunks;
+          idle_chunks = chunk;
+
+          for (i = LITE_IDLE_CHUNK_SIZE - 1; i >= 0; i--) {
+               chunk->items[i].next = idle_free;
+               idle_free            = &chunk->items[i];
+          }
+     }
+
+     item      = idle_free;
+     idle_free = item->next;
+
+     return item;
+}
+
+static void
+idle_remove( LiteWindowIdle *item )
+{
+     direct_hash_remove( idle_ids, item->id );
+
+     /* unlink the idle callback from the queue */
+     if (item->prev)
+          item->prev->next = item->next;
+     else
+          idle_queue = item->next;
+
+     if (item->next)
+          item->next->prev = item->prev;
+     else
+          idle_tail = item->prev;
+
+     /* give the idle callback back to the pool */
+     item->prev = NULL;
+     item->next = idle_free;
+     idle_free  = item;
+}
+
+static DFBResult
+remove_top_idle_callback( LiteTimeoutFunc  *callback,
+                          void            **callback_data )
+{
+     DFBResult ret = DFB_FAILURE;
+
+     direct_mutex_lock( &idle_mutex );
+
+     if (idle_queue) {
+          LiteWindowIdle *node = idle_queue;
+
+          *callback      = node->callback;
+          *callback_data = node->callback_data;
+
+          idle_remove( node );
+
+          ret = DFB_OK;
+     }
+
+     direct_mutex_unlock(&idle_mutex);
+
+     return ret;
+}
+
+DFBResult
+lite_window_event_loop( LiteWindow *window,
+                        int         timeout )
+{
+     DFBResult        ret;
+     LiteTimeoutFunc  callback;
+     void            *callback_data;
+     long long        remaining;
+     DFBEvent         evt;
+     int              timeout_id           = 0;
+
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+
+     D_DEBUG_AT( LiteWindowDomain, "Enter window event loop with timeout: %d\n", timeout );
+
+     event_loop_alive = true;
+
+     /* destroy window only when event loop ends */
+     ++window->internal_ref_count;
+
+     /* add stop timeout */
+     if (timeout > 0)
+          lite_enqueue_timeout_callback( timeout, NULL, NULL, &timeout_id );
+
+     while (true) {
+          /* first test if the alive flag is still set, otherwise exit immediately */
+          if (event_loop_alive == false) {
+               ret = DFB_OK;
+               break;
+          }
+
+          /* run tasks posted from other threads */
+          ret = run_posted_tasks();
+          if (ret != DFB_OK)
+               break;
+
+          /* release the resources of destroyed windows */
+          cleanup_windows();
+
+          if (lite_config.frame_rate > 0) {
+               /* draw when the frame is due, even while events keep arriving */
+               if (frame_due())
+                    draw_frame();
+          }
+          else if (loop_clock_millis() - last_update_time >= lite_config.minimum_update_freq) {
+               /* flush window-specific events and redraw all windows that have been changed due to events */
+               draw_frame();
+          }
+
+          /* get the next event, taken from the buffer in batches */
+          ret = next_batched_event( &evt );
+          if (ret == DFB_OK) {
+               /* dispatch the event to the window-specific event handler */
+               if (evt.clazz == DFEC_USER) {
+                    if (window->user_event_func)
+                         window->user_event_func( (DFBUserEvent*) &evt, window->user_event_data );
+               }
+               else if (evt.clazz == DFEC_UNIVERSAL) {
+                    if (window->universal_event_func)
+                         window->universal_event_func( (DFBUniversalEvent*) &evt, window->universal_event_data );
+               }
+               else if (evt.clazz == DFEC_WINDOW) {
+                    DFBWindowEvent *win_event            = (DFBWindowEvent*) &evt;
+                    bool            handle_window_events = true;
+
+                    /* if we have a window event callback, the event is intercepted and can be handled */
+                    if (window->window_event_func) {
+                        ret = window->window_event_func( win_event, window->window_event_data );
+                        if (ret != DFB_OK) {
+                            /* the window event callback indicates that the event is handled and should no longer be
+                               processed */
+                            handle_window_events = false;
+                        }
+                    }
+
+                    /* process the event unles a possible window event callback indicates that it was handled */
+                    if (handle_window_events == true) {
+                         int result = lite_handle_window_event( find_window_by_id( win_event->window_id ), win_event );
+
+                         /* the last window is destroyed or closed, or the current window is destroyed */
+                         if (win_event->type == DWET_DESTROYED || result < 0) {
+                              if (num_windows_global == 0 || window->id == win_event->window_id) {
+                                   ret = DFB_DESTROYED;
+                                   break;
+                              }
+                         }
+                         else if (win_event->type == DWET_CLOSE) {
+                              if (num_windows_global == 1) {
+                                   lite_destroy_window( window );
+                                   ret = DFB_DESTROYED;
+                                   break;
+                              }
+                         }
+                    }
+               }
+
+               continue;
+          }
+
+          /* flush window-specific events and redraw any windows that have been changed due to events, with a frame
+             clock this is deferred until the frame is due unless the event loop runs only once */
+          if (lite_config.frame_rate <= 0 || timeout < 0 || frame_due())
+               draw_frame();
+
+          /* now check timeout callbacks */
+          ret = remove_next_timeout_callback( &callback, &callback_data );
+          if (ret == DFB_OK) {
+               record_firing( LITE_RECORD_TIMEOUT );
+
+               if (callback) {
+                    ret = callback( callback_data );
+                    if (ret != DFB_OK)
+                         break;
+               }
+               else {
+                    ret = DFB_TIMEOUT;
+                    break;
+               }
+
+               continue;
+          }
+
+          /* now check idle callbacks */
           ret = remove_top_idle_callback( &callback, &callback_data );
           if (ret == DFB_OK) {
+               record_firing( LITE_RECORD_IDLE );
+
                if (callback) {
                     ret = callback( callback_data );
                     if (ret != DFB_OK)
@@ -749,8 +1705,38 @@ lite_window_event_loop( LiteWindow *window,
                continue;
           }
 
+          /* tasks posted meanwhile are run without waiting for their wake up event */
+          if (task_stack)
+               continue;
+
           /* wait for the next event */
           ret = get_time_until_next_timeout( &remaining );
+
+          /* wake up in time for a scheduled frame */
+          if (frame_scheduled) {
+               long long frame_remaining = (frame_deadline - loop_clock_micros() + 999) / 1000;
+
+               if (ret != DFB_OK || frame_remaining < remaining)
+                    remaining = MAX( frame_remaining, 0 );
+
+               ret = DFB_OK;
+          }
+
+          /* no waiting while replaying, the virtual clock jumps to the next recorded event, timeout or frame */
+          if (replay_active) {
+               if (!replay_advance_clock( ret == DFB_OK ? remaining : -1 )) {
+                    ret = DFB_EOF;
+                    break;
+               }
+
+               if (timeout < 0) {
+                    ret = DFB_OK;
+                    break;
+               }
+
+               continue;
+          }
+
           if (ret == DFB_OK) {
                event_buffer_global->WaitForEventWithTimeout( event_buffer_global, remaining / 1000, remaining % 1000 );
           }
@@ -776,6 +1762,146 @@ lite_window_event_loop( LiteWindow *window,
      return ret;
 }
 
+DFBResult
+lite_get_frame_stats( LiteFrameStats *ret_stats )
+{
+     LITE_NULL_PARAMETER_CHECK( ret_stats );
+
+     D_DEBUG_AT( LiteWindowDomain, "Get frame statistics\n" );
+
+     *ret_stats = frame_stats;
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_get_window_latency( LiteWindow       *window,
+                         LiteLatencyStats *ret_stats )
+{
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+     LITE_NULL_PARAMETER_CHECK( ret_stats );
+
+     D_DEBUG_AT( LiteWindowDomain, "Get latency of window %p\n", window );
+
+     memset( ret_stats, 0, sizeof(LiteLatencyStats) );
+
+     direct_mutex_lock( &window->updates.lock );
+
+     if (window->latency.count) {
+          ret_stats->count = window->latency.count;
+          ret_stats->p50   = latency_percentile( window, 50 );
+          ret_stats->p95   = latency_percentile( window, 95 );
+          ret_stats->p99   = latency_percentile( window, 99 );
+          ret_stats->max   = window->latency.max;
+     }
+
+     direct_mutex_unlock( &window->updates.lock );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_reset_window_latency( LiteWindow *window )
+{
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+
+     D_DEBUG_AT( LiteWindowDomain, "Reset latency of window %p\n", window );
+
+     direct_mutex_lock( &window->updates.lock );
+
+     if (window->latency.buckets)
+          memset( window->latency.buckets, 0, LITE_LATENCY_BUCKETS * sizeof(u32) );
+
+     window->latency.count = 0;
+     window->latency.max   = 0;
+
+     direct_mutex_unlock( &window->updates.lock );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_record_events( const char *filename )
+{
+     DirectResult         ret;
+     LiteRecordFileHeader header;
+
+     D_DEBUG_AT( LiteWindowDomain, "Record events to '%s'\n", filename ? filename : "(stop)" );
+
+     if (record_active) {
+          direct_file_close( &record_file );
+          record_active = false;
+     }
+
+     if (!filename)
+          return DFB_OK;
+
+     ret = direct_file_open( &record_file, filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+     if (ret) {
+          D_DERROR( ret, "LiTE/Window: Could not create event recording '%s'!\n", filename );
+          return ret;
+     }
+
+     memset( &header, 0, sizeof(header) );
+     memcpy( header.magic, LITE_RECORD_MAGIC, sizeof(header.magic) );
+     header.version    = LITE_RECORD_VERSION;
+     header.event_size = sizeof(DFBEvent);
+
+     ret = direct_file_write( &record_file, &header, sizeof(header), NULL );
+     if (ret) {
+          direct_file_close( &record_file );
+          return ret;
+     }
+
+     record_active = true;
+     record_start  = loop_clock_micros();
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_replay_events( const char *filename )
+{
+     DirectResult         ret;
+     LiteRecordFileHeader header;
+
+     LITE_NULL_PARAMETER_CHECK( filename );
+
+     D_DEBUG_AT( LiteWindowDomain, "Replay events from '%s'\n", filename );
+
+     if (replay_active)
+          replay_finish();
+
+     ret = direct_file_open( &replay_file, filename, O_RDONLY, 0 );
+     if (ret) {
+          D_DERROR( ret, "LiTE/Window: Could not open event recording '%s'!\n", filename );
+          return ret;
+     }
+
+     if (!replay_read( &header, sizeof(header) ) || memcmp( header.magic, LITE_RECORD_MAGIC, sizeof(header.magic) ) ||
+         header.version != LITE_RECORD_VERSION || header.event_size != sizeof(DFBEvent)) {
+          D_ERROR( "LiTE/Window: Invalid event recording '%s'!\n", filename );
+          direct_file_close( &replay_file );
+          return DFB_UNSUPPORTED;
+     }
+
+     memset( replay_recorded, 0, sizeof(replay_recorded) );
+     memset( replay_fired, 0, sizeof(replay_fired) );
+
+     replay_inputs = 0;
+
+     /* the virtual clock continues from the current time */
+     replay_clock  = direct_clock_get_micros();
+     replay_start  = replay_clock;
+     replay_active = true;
+
+     replay_load_next();
+
+     return DFB_OK;
+}
+
 static DFBResult
 wakeup_event_loop( void )
 {
@@ -829,15 +1955,28 @@ lite_enqueue_timeout_callback( int              timeout,
 
      direct_mutex_lock( &timeout_mutex );
 
-     new_item = D_CALLOC( 1, sizeof(LiteWindowTimeout) );
+     if (!timeout_ids)
+          direct_hash_create( 17, &timeout_ids );
+
+     if (timeout_count == timeout_capacity) {
+          timeout_capacity = timeout_capacity ? timeout_capacity * 2 : LITE_TIMEOUT_CHUNK_SIZE;
+          timeout_heap     = D_REALLOC( timeout_heap, timeout_capacity * sizeof(LiteWindowTimeout*) );
+     }
+
+     new_item = timeout_alloc();
 
-     new_item->timeout       = direct_clock_get_millis() + timeout;
+     new_item->timeout       = loop_clock_millis() + timeout;
+     new_item->serial        = timeout_next_serial++;
      new_item->callback      = callback;
      new_item->callback_data = callback_data;
-     new_item->id            = timeout_next_id++;
 
-     if (timeout_next_id == 0)
-          timeout_next_id = 1;
+     /* skip ids still in use after a wrap around */
+     do {
+          new_item->id = timeout_next_id++;
+
+          if (timeout_next_id == 0)
+               timeout_next_id = 1;
+     } while (direct_hash_lookup( timeout_ids, new_item->id ));
 
      if (ret_timeout_id)
           *ret_timeout_id = new_item->id;
@@ -847,11 +1986,10 @@ lite_enqueue_timeout_callback( int              timeout,
                  new_item->callback, new_item->callback_data );
 
      /* insert after all other items with same or newer timeout */
-     LiteWindowTimeout **queue = &timeout_queue;
-     while (*queue && (*queue)->timeout <= new_item->timeout)
-          queue = &(*queue)->next;
-     new_item->next = *queue;
-     *queue = new_item;
+     direct_hash_insert( timeout_ids, new_item->id, new_item );
+
+     timeout_heap_set( timeout_count, new_item );
+     timeout_heap_up( timeout_count++ );
 
      direct_mutex_unlock( &timeout_mutex );
 
@@ -869,21 +2007,12 @@ lite_remove_timeout_callback( int timeout_id )
 
      direct_mutex_lock( &timeout_mutex );
 
-     LiteWindowTimeout **queue = &timeout_queue;
-     LiteWindowTimeout  *node  = timeout_queue;
+     LiteWindowTimeout *node = timeout_ids ? direct_hash_lookup( timeout_ids, timeout_id ) : NULL;
 
-     while (node) {
-          if (node->id == timeout_id) {
-               *queue = node->next;
+     if (node) {
+          timeout_remove( node );
 
-               D_FREE( node );
-
-               ret = DFB_OK;
-               break;
-          }
-
-          queue = &node->next;
-          node  = node->next;
+          ret = DFB_OK;
      }
 
      direct_mutex_unlock( &timeout_mutex );
@@ -893,18 +2022,54 @@ lite_remove_timeout_callback( int timeout_id )
      return ret;
 }
 
+DFBResult
+lite_post_task( LiteTimeoutFunc  callback,
+                void            *callback_data )
+{
+     LiteWindowTask *task;
+     LiteWindowTask *head;
+
+     LITE_NULL_PARAMETER_CHECK( callback );
+
+     D_DEBUG_AT( LiteWindowDomain, "Post task with callback: %p( %p )\n", callback, callback_data );
+
+     task = D_MALLOC( sizeof(LiteWindowTask) );
+
+     task->callback      = callback;
+     task->callback_data = callback_data;
+
+     do {
+          head       = task_stack;
+          task->next = head;
+     } while (!D_SYNC_BOOL_COMPARE_AND_SWAP( &task_stack, head, task ));
+
+     /* only the first task of a batch wakes up the event loop, the others are taken with it; the wake up is posted as an
+        event, so it is not lost if the loop is about to wait */
+     if (!head && event_buffer_global) {
+          DFBUserEvent event;
+
+          event.clazz = DFEC_USER;
+          event.type  = LITE_TASK_EVENT_TYPE;
+          event.data  = &task_stack;
+
+          return event_buffer_global->PostEvent( event_buffer_global, DFB_EVENT(&event) );
+     }
+
+     return DFB_OK;
+}
+
 DFBResult
 lite_rebase_window_timeouts( long long adjustment )
 {
+     int i;
+
      direct_mutex_lock( &timeout_mutex );
 
      D_DEBUG_AT( LiteWindowDomain, "Rebase all timeout callbacks\n" );
 
-     LiteWindowTimeout *current = timeout_queue;
-     while (current) {
-          current->timeout += adjustment;
-          current = current->next;
-     }
+     /* shifting all trigger times by the same amount keeps the heap order */
+     for (i = 0; i < timeout_count; i++)
+          timeout_heap[i]->timeout += adjustment;
 
      direct_mutex_unlock( &timeout_mutex );
 
@@ -922,14 +2087,21 @@ lite_enqueue_idle_callback( LiteTimeoutFunc  callback,
 
      direct_mutex_lock( &idle_mutex );
 
-     new_item = D_CALLOC( 1, sizeof(LiteWindowIdle) );
+     if (!idle_ids)
+          direct_hash_create( 17, &idle_ids );
+
+     new_item = idle_alloc();
 
      new_item->callback      = callback;
      new_item->callback_data = callback_data;
-     new_item->id            = idle_next_id++;
 
-     if (idle_next_id == 0)
-          idle_next_id = 1;
+     /* skip ids still in use after a wrap around */
+     do {
+          new_item->id = idle_next_id++;
+
+          if (idle_next_id == 0)
+               idle_next_id = 1;
+     } while (direct_hash_lookup( idle_ids, new_item->id ));
 
      if (ret_idle_id)
           *ret_idle_id = new_item->id;
@@ -938,10 +2110,17 @@ lite_enqueue_idle_callback( LiteTimeoutFunc  callback,
                  new_item->id, new_item->callback, new_item->callback_data );
 
      /* insert after all other items */
-     LiteWindowIdle **queue = &idle_queue;
-     while (*queue)
-          queue = &(*queue)->next;
-     *queue = new_item;
+     direct_hash_insert( idle_ids, new_item->id, new_item );
+
+     new_item->next = NULL;
+     new_item->prev = idle_tail;
+
+     if (idle_tail)
+          idle_tail->next = new_item;
+     else
+          idle_queue = new_item;
+
+     idle_tail = new_item;
 
      direct_mutex_unlock( &idle_mutex );
 
@@ -959,21 +2138,12 @@ lite_remove_idle_callback( int idle_id )
 
      direct_mutex_lock( &idle_mutex );
 
-     LiteWindowIdle **queue = &idle_queue;
-     LiteWindowIdle  *node  = idle_queue;
-
-     while (node) {
-          if ((*queue)->id == idle_id) {
-               *queue = node->next;
-
-               D_FREE( node );
+     LiteWindowIdle *node = idle_ids ? direct_hash_lookup( idle_ids, idle_id ) : NULL;
 
-               ret = DFB_OK;
-               break;
-          }
+     if (node) {
+          idle_remove( node );
 
-          queue = &node->next;
-          node  = node->next;
+          ret = DFB_OK;
      }
 
      direct_mutex_unlock( &idle_mutex );
@@ -987,7 +2157,19 @@ DFBResult
 lite_update_window( LiteWindow      *window,
                     const DFBRegion *region )
 {
-     int       i;
+     LITE_NULL_PARAMETER_CHECK( window );
+
+     /* the window content changes beneath all cached boxes */
+     prvlite_box_damage( LITE_BOX(window), region );
+
+     return prvlite_update_window( window, region, NULL );
+}
+
+DFBResult
+prvlite_update_window( LiteWindow      *window,
+                       const DFBRegion *region,
+                       LiteBox         *floor )
+{
      DFBRegion update;
 
      LITE_NULL_PARAMETER_CHECK( window );
@@ -1016,48 +2198,129 @@ lite_update_window( LiteWindow      *window,
 
      direct_mutex_lock( &window->updates.lock );
 
+     /* collect the update until the transaction ends */
+     if (window->transaction.depth || transaction_depth) {
+          transaction_add( window, &update, floor );
+          direct_mutex_unlock( &window->updates.lock );
+          return DFB_OK;
+     }
+
      if (window->flags & LITE_WINDOW_PENDING_RESIZE) {
           D_DEBUG_AT( LiteUpdateDomain, "  -> resize is pending, not queuing an update...\n" );
           direct_mutex_unlock( &window->updates.lock );
           return DFB_OK;
      }
 
-     if (window->updates.pending == LITE_WINDOW_MAX_UPDATES) {
-         D_DEBUG_AT( LiteUpdateDomain, "  -> max updates (%d) reached, merging...\n", LITE_WINDOW_MAX_UPDATES );
+     window->updates.stats.requested_pixels += region_area( &update );
+     window->updates.stats.requests++;
+
+     damage_add( window, &update );
+
+     dirty_add( window, &update, floor );
+
+     /* keep the time of the oldest input waiting for this damage to be shown */
+     if (input_origin && (!window->updates.input_origin || input_origin < window->updates.input_origin))
+          window->updates.input_origin = input_origin;
+
+     /* queue the window for drawing, and for checking whether the box under the cursor changed */
+     worklist_add( LITE_WORKLIST_UPDATES, window );
+     worklist_add( LITE_WORKLIST_EVENTS, window );
+
+     direct_mutex_unlock( &window->updates.lock );
+
+     wakeup_event_loop();
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_begin_update( LiteWindow *window )
+{
+     D_DEBUG_AT( LiteUpdateDomain, "%s( %p )\n", __FUNCTION__, window );
+
+     if (window) {
+          LITE_WINDOW_PARAMETER_CHECK( window );
 
-         for (i = 1; i < window->updates.pending; i++)
-             dfb_region_region_union( &window->updates.regions[0], &window->updates.regions[i] );
+          direct_mutex_lock( &window->updates.lock );
 
-         window->updates.pending = 1;
+          window->transaction.depth++;
 
-         D_DEBUG_AT( LiteUpdateDomain, "  -> new single update: " DFB_RECT_FORMAT " [0]\n",
-                     DFB_RECTANGLE_VALS_FROM_REGION( &window->updates.regions[0] ) );
+          direct_mutex_unlock( &window->updates.lock );
      }
+     else
+          D_SYNC_ADD( &transaction_depth, 1 );
 
-     for (i = 0; i < window->updates.pending; i++) {
-         if (dfb_region_region_intersects( &update, &window->updates.regions[i] )) {
-             D_DEBUG_AT( LiteUpdateDomain, "  -> intersection, merging...\n" );
+     return DFB_OK;
+}
+
+DFBResult
+lite_end_update( LiteWindow *window )
+{
+     int  n;
+     int  depth;
+     bool queued = false;
 
-             dfb_region_region_union( &window->updates.regions[i], &update );
+     D_DEBUG_AT( LiteUpdateDomain, "%s( %p )\n", __FUNCTION__, window );
 
-             D_DEBUG_AT( LiteUpdateDomain, "  -> new update: " DFB_RECT_FORMAT " [%d]\n",
-                         DFB_RECTANGLE_VALS_FROM_REGION( &window->updates.regions[i] ), i );
-             break;
-         }
+     if (window) {
+          LITE_WINDOW_PARAMETER_CHECK( window );
+
+          direct_mutex_lock( &window->updates.lock );
+
+          if (!window->transaction.depth) {
+               direct_mutex_unlock( &window->updates.lock );
+               return DFB_FAILURE;
+          }
+
+          if (!--window->transaction.depth && !transaction_depth)
+               queued = transaction_submit( window );
+
+          direct_mutex_unlock( &window->updates.lock );
      }
+     else {
+          do {
+               depth = transaction_depth;
+               if (!depth)
+                    return DFB_FAILURE;
+          } while (!D_SYNC_BOOL_COMPARE_AND_SWAP( &transaction_depth, depth, depth - 1 ));
+
+          if (depth > 1)
+               return DFB_OK;
+
+          /* updates collected after the decrement are submitted here too, they are added with the window lock */
+          for (n = 0; n < num_windows_global; n++) {
+               LiteWindow *other = window_array_global[n];
 
-     if (i == window->updates.pending) {
-         D_DEBUG_AT( LiteUpdateDomain, "  -> adding: " DFB_RECT_FORMAT " [%d]\n",
-                     DFB_RECTANGLE_VALS_FROM_REGION( &update ), i );
+               direct_mutex_lock( &other->updates.lock );
 
-         window->updates.regions[i] = update;
+               if (!other->transaction.depth && transaction_submit( other ))
+                    queued = true;
 
-         window->updates.pending++;
+               direct_mutex_unlock( &other->updates.lock );
+          }
      }
 
-     direct_mutex_unlock( &window->updates.lock );
+     if (!queued)
+          return DFB_OK;
 
-     wakeup_event_loop();
+     return wakeup_event_loop();
+}
+
+DFBResult
+lite_get_window_update_stats( LiteWindow            *window,
+                              LiteWindowUpdateStats *ret_stats )
+{
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+     LITE_NULL_PARAMETER_CHECK( ret_stats );
+
+     D_DEBUG_AT( LiteWindowDomain, "Get update statistics of window %p\n", window );
+
+     direct_mutex_lock( &window->updates.lock );
+
+     *ret_stats = window->updates.stats;
+
+     direct_mutex_unlock( &window->updates.lock );
 
      return DFB_OK;
 }
@@ -1117,7 +2380,7 @@ lite_set_window_title( LiteWindow *window,
 
           region = DFB_REGION_INIT_FROM_RECTANGLE( &window->theme->frame.parts[LITE_THEME_FRAME_PART_TOP].rect );
 
-          surface->Flip( surface, &region, getenv( "LITE_WINDOW_DOUBLEBUFFER" ) ? DSFLIP_BLIT: DSFLIP_NONE );
+          surface->Flip( surface, &region, lite_config.window_doublebuffer ? DSFLIP_BLIT: DSFLIP_NONE );
      }
 
      return DFB_OK;
@@ -1274,7 +2537,8 @@ lite_resize_window( LiteWindow   *window,
      window->flags |= LITE_WINDOW_PENDING_RESIZE;
      window->flags &= ~LITE_WINDOW_DRAWN;
 
-     window->updates.pending = 0;
+     window->updates.pending   = 0;
+     window->updates.num_dirty = 0;
 
      direct_mutex_unlock( &window->updates.lock );
 
@@ -1334,7 +2598,8 @@ lite_set_window_bounds( LiteWindow   *window,
      window->flags |= LITE_WINDOW_PENDING_RESIZE;
      window->flags &= ~LITE_WINDOW_DRAWN;
 
-     window->updates.pending = 0;
+     window->updates.pending   = 0;
+     window->updates.num_dirty = 0;
 
      direct_mutex_unlock( &window->updates.lock );
 
@@ -1377,6 +2642,10 @@ lite_find_my_window( LiteBox *box )
 
      D_DEBUG_AT( LiteWindowDomain, "Find window for box: %p\n", box );
 
+     /* known once the box has been added to the box tree of a window */
+     if (box->window)
+          return box->window;
+
      while (box->parent)
           box = box->parent;
 
@@ -1471,6 +2740,9 @@ lite_window_event_available()
 
      D_DEBUG_AT( LiteWindowDomain, "Check event availability\n" );
 
+     if (event_batch_next < event_batch_count)
+          return DFB_OK;
+
      ret = event_buffer_global->HasEvent( event_buffer_global );
      if (ret == DFB_OK)
           return DFB_OK;
@@ -1486,7 +2758,9 @@ int
 lite_handle_window_event( LiteWindow     *window,
                           DFBWindowEvent *event )
 {
-     int       result = 0;
+     int       result       = 0;
+     int       index;
+     long long saved_origin = input_origin;
      DFBResult ret;
 
      D_DEBUG_AT( LiteWindowDomain, "Handle event: %p for window: %p\n", event, window );
@@ -1508,119 +2782,33 @@ lite_handle_window_event( LiteWindow     *window,
      /* no destruction when handling window events */
      ++window->internal_ref_count;
 
-     /* raw callbacks that can be installed to intercept events */
-     if (!(window->flags & LITE_WINDOW_DISABLED)) {
-          if (event->type == DWET_BUTTONUP || event->type == DWET_BUTTONDOWN) {
-               if (window->raw_mouse_func) {
-                    ret = window->raw_mouse_func( event, window->raw_mouse_data );
-                    /* return if the callback indicates tot stop processing the event */
-                    if (ret != DFB_OK) {
-                         --window->internal_ref_count;
-                         return 0;
-                    }
-               }
-          }
-          else if (event->type == DWET_MOTION) {
-               if (window->raw_mouse_moved_func) {
-                    ret = window->raw_mouse_moved_func( event, window->raw_mouse_data );
-                    /* return if the callback indicates tot stop processing the event */
-                    if (ret != DFB_OK) {
-                         --window->internal_ref_count;
-                         return 0;
-                    }
-               }
-          }
-          else if (event->type == DWET_KEYUP || event->type == DWET_KEYDOWN) {
-               if (window->raw_keyboard_func) {
-                    ret = window->raw_keyboard_func( event, window->raw_keyboard_data );
-                    /* return if the callback indicates tot stop processing the event */
-                    if (ret != DFB_OK) {
-                         --window->internal_ref_count;
-                         return 0;
-                    }
-               }
-          }
-          else if (event->type == DWET_WHEEL) {
-               if (window->raw_wheel_func) {
-                    ret = window->raw_wheel_func( event, window->raw_wheel_data );
-                    /* return if the callback indicates tot stop processing the event */
-                    if (ret != DFB_OK) {
-                         --window->internal_ref_count;
-                         return 0;
-                    }
-               }
-          }
-     }
-
-     /* events handled by all windows */
-     switch (event->type) {
-          case DWET_POSITION:
-               result = handle_move( window, event );
-               break;
-          case DWET_SIZE:
-               window->last_resize = *event;
-               break;
-          case DWET_POSITION_SIZE:
-               result = handle_move( window, event );
-               if (window->flags & LITE_WINDOW_CONFIGURED)
-                    window->last_resize = *event;
-               else
-                    window->flags |= LITE_WINDOW_CONFIGURED;
-               break;
-          case DWET_CLOSE:
-               result = handle_close( window );
-               break;
-          case DWET_LOSTFOCUS:
-               result = handle_lost_focus( window );
-               break;
-          case DWET_GOTFOCUS:
-               result = handle_got_focus( window );
-               break;
-          default:
-               break;
-     }
+     index = event_type_index( event->type );
 
-     /* events handled by enabled windows */
-     if (!(window->flags & LITE_WINDOW_DISABLED)) {
-          switch (event->type) {
-               case DWET_ENTER:
-                    window->last_motion = *event;
-                    result = handle_enter( window, event );
-                    break;
-               case DWET_LEAVE:
-                    result = handle_leave( window, event );
-                    break;
-               case DWET_MOTION:
-                    window->last_motion = *event;
-                    if (window->mouse_func)
-                         window->mouse_func( event, window->mouse_data );
-                    break;
-               case DWET_BUTTONUP:
-               case DWET_BUTTONDOWN:
-                    result = handle_button( window, event );
-                    if (window->mouse_func && !(window->flags & LITE_WINDOW_DESTROYED))
-                         window->mouse_func( event, window->mouse_data );
-                    break;
-               case DWET_KEYUP:
-                    result = handle_key_up( window, event );
-                    if (window->keyboard_func && !(window->flags & LITE_WINDOW_DESTROYED))
-                         window->keyboard_func( event, window->keyboard_data );
-                    break;
-               case DWET_KEYDOWN:
-                    result = handle_key_down( window, event );
-                    if (window->keyboard_func && !(window->flags & LITE_WINDOW_DESTROYED))
-                         window->keyboard_func( event, window->keyboard_data );
-                    break;
-               case DWET_WHEEL:
-                    result = handle_wheel( window, event );
-                    if (window->wheel_func && !(window->flags & LITE_WINDOW_DESTROYED))
-                         window->wheel_func( event, window->wheel_data );
-                    break;
-               default:
-                    break;
+     /* tag the damage caused by input events with the time of the event */
+     if (event->type & LITE_INPUT_EVENTS)
+          input_origin = event_origin( event );
+
+     /* raw callbacks that can be installed to intercept events */
+     if (!(window->flags & LITE_WINDOW_DISABLED) && window->raw_handlers[index].func) {
+          ret = window->raw_handlers[index].func( event, window->raw_handlers[index].data );
+          /* return if the callback indicates tot stop processing the event */
+          if (ret != DFB_OK) {
+               input_origin = saved_origin;
+               --window->internal_ref_count;
+               return 0;
           }
      }
 
+     if (!event_handlers_inited)
+          init_event_handlers();
+
+     /* events handled by all windows, or by enabled windows only */
+     if (event_handlers[index].handler &&
+         (!event_handlers[index].enabled_only || !(window->flags & LITE_WINDOW_DISABLED)))
+          result = event_handlers[index].handler( window, event );
+
+     input_origin = saved_origin;
+
      /* remove the reference */
      --window->internal_ref_count;
 
@@ -1644,17 +2832,11 @@ child_coords( LiteBox *box,
               int     *x,
               int     *y )
 {
-     int tx = *x;
-     int ty = *y;
-
-     while (box) {
-          tx -= box->rect.x;
-          ty -= box->rect.y;
-          box = box->parent;
-     }
+     prvlite_box_validate( box );
 
-     *x = tx;
-     *y = ty;
+     /* the cached origin is relative to the top level box, which is offset itself */
+     *x -= box->cached.x + box->cached.root->rect.x;
+     *y -= box->cached.y + box->cached.root->rect.y;
 }
 
 DFBResult
@@ -1717,18 +2899,24 @@ lite_flush_window_events( LiteWindow *window )
                     }
                }
                else if (window->last_motion.type) {
+                    long long saved_origin = input_origin;
+
+                    input_origin = event_origin( &window->last_motion );
+
                     handle_motion( window, &window->last_motion );
 
+                    input_origin = saved_origin;
+
                     window->last_motion.type = DWET_NONE;
                }
           }
      }
      else {
-          int n;
+          /* only visit windows with pending events, windows queued while flushing are handled in the next pass */
+          int n = worklist_count( LITE_WORKLIST_EVENTS );
 
-          for (n = 0; n < num_windows_global; n++) {
-               lite_flush_window_events( window_array_global[n] );
-          }
+          while (n-- > 0 && (window = worklist_pop( LITE_WORKLIST_EVENTS )) != NULL)
+               lite_flush_window_events( window );
      }
 
      return DFB_OK;
@@ -1757,6 +2945,9 @@ destroy_window_data( LiteWindow *window )
 
      lite_release_window_drag_box( window );
 
+     if (lite_config.latency_dump)
+          latency_dump( window );
+
      if (window->title)
           D_FREE( window->title );
 
@@ -1830,6 +3021,9 @@ lite_on_raw_window_mouse( LiteWindow          *window,
      window->raw_mouse_func = callback;
      window->raw_mouse_data = data;
 
+     set_raw_handler( window, DWET_BUTTONDOWN, callback, data );
+     set_raw_handler( window, DWET_BUTTONUP,   callback, data );
+
      return 0;
 }
 
@@ -1846,6 +3040,8 @@ lite_on_raw_window_mouse_moved( LiteWindow          *window,
      window->raw_mouse_moved_func = callback;
      window->raw_mouse_moved_data = data;
 
+     set_raw_handler( window, DWET_MOTION, callback, data );
+
      return 0;
 }
 
@@ -1878,6 +3074,9 @@ lite_on_raw_window_keyboard( LiteWindow          *window,
      window->raw_keyboard_func = callback;
      window->raw_keyboard_data = data;
 
+     set_raw_handler( window, DWET_KEYDOWN, callback, data );
+     set_raw_handler( window, DWET_KEYUP,   callback, data );
+
      return 0;
 }
 
@@ -1921,129 +3120,527 @@ lite_on_window_universal_event( LiteWindow                   *window,
      LITE_NULL_PARAMETER_CHECK( window );
      LITE_WINDOW_PARAMETER_CHECK( window );
 
-     D_DEBUG_AT( LiteWindowDomain, "Install universal event callback\n" );
+     D_DEBUG_AT( LiteWindowDomain, "Install universal event callback\n" );
+
+     window->universal_event_func = callback;
+     window->universal_event_data = data;
+
+     return 0;
+}
+
+DFBResult
+lite_on_window_user_event( LiteWindow              *window,
+                           LiteWindowUserEventFunc  callback,
+                           void                    *data )
+{
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+
+     D_DEBUG_AT( LiteWindowDomain, "Install user event callback\n" );
+
+     window->user_event_func = callback;
+     window->user_event_data = data;
+
+     return 0;
+}
+
+DFBResult
+lite_on_raw_window_wheel( LiteWindow          *window,
+                          LiteWindowEventFunc  callback,
+                          void                *data )
+{
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+
+     D_DEBUG_AT( LiteWindowDomain, "Install raw scroll wheel event callback\n" );
+
+     window->raw_wheel_func = callback;
+     window->raw_wheel_data = data;
+
+     set_raw_handler( window, DWET_WHEEL, callback, data );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_on_window_wheel( LiteWindow          *window,
+                      LiteWindowEventFunc  callback,
+                      void                *data )
+{
+     LITE_NULL_PARAMETER_CHECK( window );
+     LITE_WINDOW_PARAMETER_CHECK( window );
+
+     D_DEBUG_AT( LiteWindowDomain, "Install scroll wheel event callback\n" );
+
+     window->wheel_func = callback;
+     window->wheel_data = data;
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_new_window_theme( const DFBColor     *bg_color,
+                       const char         *spec,
+                       LiteFontStyle       style,
+                       int                 size,
+                       DFBFontAttributes   attr,
+                       const void         *file_data[LITE_THEME_FRAME_PART_NUM],
+                       unsigned int        length[LITE_THEME_FRAME_PART_NUM],
+                       LiteWindowTheme   **ret_theme )
+{
+     DFBResult        ret;
+     LiteWindowTheme *theme;
+
+     LITE_NULL_PARAMETER_CHECK( bg_color );
+     LITE_NULL_PARAMETER_CHECK( file_data );
+     LITE_NULL_PARAMETER_CHECK( ret_theme );
+
+     if (liteDefaultWindowTheme && *ret_theme == liteDefaultWindowTheme)
+          return DFB_OK;
+
+     theme = D_CALLOC( 1, sizeof(LiteWindowTheme) );
+
+     /* configure the default background color */
+     theme->theme.bg_color = *bg_color;
+
+     /* load title font */
+     ret = lite_get_font( spec, style, size, attr, &theme->title_font );
+     if (ret != DFB_OK) {
+          D_FREE( theme );
+          return ret;
+     }
+
+     /* load frame bitmaps */
+     ret = lite_theme_frame_load( &theme->frame, file_data, length );
+     if (ret != DFB_OK) {
+          lite_release_font( theme->title_font );
+          D_FREE( theme );
+          return ret;
+     }
+
+     *ret_theme = theme;
+
+     D_DEBUG_AT( LiteWindowDomain, "Created new window theme: %p\n", theme );
+
+     return DFB_OK;
+}
+
+DFBResult
+lite_destroy_window_theme( LiteWindowTheme *theme )
+{
+     LITE_NULL_PARAMETER_CHECK( theme );
+
+     D_DEBUG_AT( LiteWindowDomain, "Destroy window theme: %p\n", theme );
+
+     lite_theme_frame_unload( &theme->frame );
+
+     lite_release_font( theme->title_font );
+
+     D_FREE( theme );
+
+     if (theme == liteDefaultWindowTheme)
+          liteDefaultWindowTheme = NULL;
+
+     return DFB_OK;
+}
+
+/* internals */
+
+static void
+register_window( LiteWindow *window )
+{
+     D_ASSERT( window != NULL );
+
+     if (!window_ids_global)
+          direct_hash_create( 17, &window_ids_global );
+
+     /* grow the window array geometrically */
+     if (num_windows_global == max_windows_global) {
+          max_windows_global  = max_windows_global ? max_windows_global * 2 : 8;
+          window_array_global = D_REALLOC( window_array_global, max_windows_global * sizeof(LiteWindow*) );
+     }
+
+     window_array_global[num_windows_global++] = window;
+
+     direct_hash_insert( window_ids_global, window->id, window );
+
+     window->serial = window_serial_next++;
+}
+
+static bool
+unregister_window( LiteWindow *window )
+{
+     int n;
+
+     D_ASSERT( window != NULL );
+
+     for (n = 0; n < num_windows_global; n++)
+          if (window_array_global[n] == window)
+               break;
+
+     if (n == num_windows_global)
+          return false;
+
+     /* keep the creation order, it is used to restore modality and to destroy windows */
+     num_windows_global--;
+
+     direct_memmove( &window_array_global[n], &window_array_global[n+1],
+                     (num_windows_global - n) * sizeof(LiteWindow*) );
+
+     if (direct_hash_lookup( window_ids_global, window->id ) == window)
+          direct_hash_remove( window_ids_global, window->id );
+
+     return true;
+}
+
+static void
+worklist_add( LiteWorklistType  type,
+              LiteWindow       *window )
+{
+     LiteWorklist *list = &worklists[type];
+
+     D_ASSERT( window != NULL );
+
+     direct_mutex_lock( &worklist_mutex );
+
+     if (!window->worklists[type].queued) {
+          window->worklists[type].queued = 1;
+          window->worklists[type].next   = NULL;
+
+          if (list->last)
+               list->last->worklists[type].next = window;
+          else
+               list->first = window;
+
+          list->last = window;
+          list->count++;
+     }
+
+     direct_mutex_unlock( &worklist_mutex );
+}
+
+static LiteWindow *
+worklist_pop( LiteWorklistType type )
+{
+     LiteWorklist *list = &worklists[type];
+     LiteWindow   *window;
+
+     direct_mutex_lock( &worklist_mutex );
+
+     window = list->first;
+     if (window) {
+          list->first = window->worklists[type].next;
+          if (!list->first)
+               list->last = NULL;
+
+          list->count--;
+
+          window->worklists[type].queued = 0;
+          window->worklists[type].next   = NULL;
+     }
+
+     direct_mutex_unlock( &worklist_mutex );
+
+     return window;
+}
+
+static int
+worklist_count( LiteWorklistType type )
+{
+     int count;
+
+     direct_mutex_lock( &worklist_mutex );
+
+     count = worklists[type].count;
+
+     direct_mutex_unlock( &worklist_mutex );
+
+     return count;
+}
+
+static void
+worklist_remove( LiteWorklistType  type,
+                 LiteWindow       *window )
+{
+     LiteWorklist *list = &worklists[type];
+     LiteWindow   *prev = NULL;
+     LiteWindow   *current;
+
+     D_ASSERT( window != NULL );
+
+     direct_mutex_lock( &worklist_mutex );
+
+     if (window->worklists[type].queued) {
+          for (current = list->first; current; prev = current, current = current->worklists[type].next) {
+               if (current == window) {
+                    if (prev)
+                         prev->worklists[type].next = window->worklists[type].next;
+                    else
+                         list->first = window->worklists[type].next;
+
+                    if (list->last == window)
+                         list->last = prev;
+
+                    list->count--;
+                    break;
+               }
+          }
+
+          window->worklists[type].queued = 0;
+          window->worklists[type].next   = NULL;
+     }
+
+     direct_mutex_unlock( &worklist_mutex );
+}
+
+/* damage accumulator, must be called with the updates lock held */
+
+static long long
+damage_merge_cost( const DFBRegion *a,
+                   const DFBRegion *b,
+                   DFBRegion       *ret_bounding )
+{
+     *ret_bounding = *a;
+
+     dfb_region_region_union( ret_bounding, b );
+
+     /* pixels drawn by the bounding box compared to drawing both regions separately */
+     return region_area( ret_bounding ) - region_area( a ) - region_area( b );
+}
+
+/* track the area of an update together with the opaque box it was caused by, merging overlapping areas */
+static void
+dirty_add( LiteWindow      *window,
+           const DFBRegion *update,
+           LiteBox         *floor )
+{
+     int       i;
+     DFBRegion region = *update;
+
+     if (window->updates.num_dirty < 0)
+          return;
+
+     if (!window->updates.num_dirty)
+          window->updates.dirty_serial = prvlite_box_geometry_serial();
+
+     for (i = 0; i < window->updates.num_dirty; i++) {
+          DFBRegion *other = &window->updates.dirty[i].region;
+
+          if (!dfb_region_region_intersects( &region, other ))
+               continue;
+
+          /* overlapping areas of different boxes are drawn completely */
+          if (window->updates.dirty[i].floor != floor)
+               floor = NULL;
+
+          region.x1 = MIN( region.x1, other->x1 );
+          region.y1 = MIN( region.y1, other->y1 );
+          region.x2 = MAX( region.x2, other->x2 );
+          region.y2 = MAX( region.y2, other->y2 );
+
+          window->updates.dirty[i] = window->updates.dirty[--window->updates.num_dirty];
+
+          /* the grown area may overlap areas already checked */
+          i = -1;
+     }
+
+     /* the merged area may leave the opaque box */
+     if (floor) {
+          prvlite_box_validate( floor );
+
+          if (region.x1 < floor->cached.clip.x1 || region.y1 < floor->cached.clip.y1 ||
+              region.x2 > floor->cached.clip.x2 || region.y2 > floor->cached.clip.y2)
+               floor = NULL;
+     }
+
+     if (window->updates.num_dirty == LITE_WINDOW_MAX_DIRTY) {
+          D_DEBUG_AT( LiteUpdateDomain, "  -> too many dirty areas, drawing pending updates completely\n" );
 
-     window->universal_event_func = callback;
-     window->universal_event_data = data;
+          window->updates.num_dirty = -1;
+          return;
+     }
 
-     return 0;
+     window->updates.dirty[window->updates.num_dirty].region = region;
+     window->updates.dirty[window->updates.num_dirty].floor  = floor;
+     window->updates.num_dirty++;
 }
 
-DFBResult
-lite_on_window_user_event( LiteWindow              *window,
-                           LiteWindowUserEventFunc  callback,
-                           void                    *data )
+static void
+transaction_add( LiteWindow      *window,
+                 const DFBRegion *update,
+                 LiteBox         *floor )
 {
-     LITE_NULL_PARAMETER_CHECK( window );
-     LITE_WINDOW_PARAMETER_CHECK( window );
+     int       i;
+     DFBRegion region = *update;
+     DFBRegion bounding;
 
-     D_DEBUG_AT( LiteWindowDomain, "Install user event callback\n" );
+     /* merge with collected areas where cheap, areas of different boxes only if they overlap */
+     for (i = 0; i < window->transaction.num_areas; i++) {
+          DFBRegion *other = &window->transaction.areas[i].region;
 
-     window->user_event_func = callback;
-     window->user_event_data = data;
+          if (damage_merge_cost( &region, other, &bounding ) > LITE_UPDATE_REGION_COST)
+               continue;
 
-     return 0;
-}
+          if (window->transaction.areas[i].floor != floor) {
+               if (!dfb_region_region_intersects( &region, other ))
+                    continue;
 
-DFBResult
-lite_on_raw_window_wheel( LiteWindow          *window,
-                          LiteWindowEventFunc  callback,
-                          void                *data )
-{
-     LITE_NULL_PARAMETER_CHECK( window );
-     LITE_WINDOW_PARAMETER_CHECK( window );
+               floor = NULL;
+          }
 
-     D_DEBUG_AT( LiteWindowDomain, "Install raw scroll wheel event callback\n" );
+          region = bounding;
 
-     window->raw_wheel_func = callback;
-     window->raw_wheel_data = data;
+          window->transaction.areas[i] = window->transaction.areas[--window->transaction.num_areas];
 
-     return DFB_OK;
-}
+          /* the grown area may now be worth merging with areas already checked */
+          i = -1;
+     }
 
-DFBResult
-lite_on_window_wheel( LiteWindow          *window,
-                      LiteWindowEventFunc  callback,
-                      void                *data )
-{
-     LITE_NULL_PARAMETER_CHECK( window );
-     LITE_WINDOW_PARAMETER_CHECK( window );
+     /* no room left, submit the collected areas early, the event loop is woken up when the transaction ends */
+     if (window->transaction.num_areas == LITE_WINDOW_MAX_DIRTY) {
+          D_DEBUG_AT( LiteUpdateDomain, "  -> transaction full, submitting collected areas\n" );
 
-     D_DEBUG_AT( LiteWindowDomain, "Install scroll wheel event callback\n" );
+          if (transaction_submit( window ))
+               window->transaction.queued = true;
+     }
 
-     window->wheel_func = callback;
-     window->wheel_data = data;
+     if (!window->transaction.num_areas)
+          window->transaction.serial = prvlite_box_geometry_serial();
 
-     return DFB_OK;
+     window->transaction.areas[window->transaction.num_areas].region = region;
+     window->transaction.areas[window->transaction.num_areas].floor  = floor;
+     window->transaction.num_areas++;
+
+     window->transaction.requested_pixels += region_area( update );
+     window->transaction.requests++;
+
+     if (input_origin && (!window->transaction.input_origin || input_origin < window->transaction.input_origin))
+          window->transaction.input_origin = input_origin;
 }
 
-DFBResult
-lite_new_window_theme( const DFBColor     *bg_color,
-                       const char         *spec,
-                       LiteFontStyle       style,
-                       int                 size,
-                       DFBFontAttributes   attr,
-                       const void         *file_data[LITE_THEME_FRAME_PART_NUM],
-                       unsigned int        length[LITE_THEME_FRAME_PART_NUM],
-                       LiteWindowTheme   **ret_theme )
+static bool
+transaction_submit( LiteWindow *window )
 {
-     DFBResult        ret;
-     LiteWindowTheme *theme;
-
-     LITE_NULL_PARAMETER_CHECK( bg_color );
-     LITE_NULL_PARAMETER_CHECK( file_data );
-     LITE_NULL_PARAMETER_CHECK( ret_theme );
+     int       i;
+     bool      queued = window->transaction.queued;
+     DFBRegion bounds = { 0, 0, window->box.rect.w - 1, window->box.rect.h - 1 };
 
-     if (liteDefaultWindowTheme && *ret_theme == liteDefaultWindowTheme)
-          return DFB_OK;
+     window->transaction.queued = false;
 
-     theme = D_CALLOC( 1, sizeof(LiteWindowTheme) );
+     if (!window->transaction.num_areas)
+          return queued;
 
-     /* configure the default background color */
-     theme->theme.bg_color = *bg_color;
+     D_DEBUG_AT( LiteUpdateDomain, "Submitting %d areas of %u requests to window %p\n",
+                 window->transaction.num_areas, window->transaction.requests, window );
 
-     /* load title font */
-     ret = lite_get_font( spec, style, size, attr, &theme->title_font );
-     if (ret != DFB_OK) {
-          D_FREE( theme );
-          return ret;
+     if (window->flags & LITE_WINDOW_PENDING_RESIZE) {
+          D_DEBUG_AT( LiteUpdateDomain, "  -> resize is pending, not queuing the updates...\n" );
      }
+     else {
+          window->updates.stats.requested_pixels += window->transaction.requested_pixels;
+          window->updates.stats.requests         += window->transaction.requests;
+          window->updates.stats.batched_requests += window->transaction.requests;
+          window->updates.stats.commits++;
 
-     /* load frame bitmaps */
-     ret = lite_theme_frame_load( &theme->frame, file_data, length );
-     if (ret != DFB_OK) {
-          lite_release_font( theme->title_font );
-          D_FREE( theme );
-          return ret;
-     }
+          for (i = 0; i < window->transaction.num_areas; i++) {
+               DFBRegion  update = window->transaction.areas[i].region;
+               LiteBox   *floor  = window->transaction.areas[i].floor;
 
-     *ret_theme = theme;
+               /* the window may have been resized meanwhile */
+               if (!dfb_region_region_intersect( &update, &bounds ))
+                    continue;
 
-     D_DEBUG_AT( LiteWindowDomain, "Created new window theme: %p\n", theme );
+               /* boxes may have been removed or destroyed meanwhile */
+               if (window->transaction.serial != prvlite_box_geometry_serial())
+                    floor = NULL;
 
-     return DFB_OK;
+               damage_add( window, &update );
+
+               dirty_add( window, &update, floor );
+          }
+
+          if (window->transaction.input_origin &&
+              (!window->updates.input_origin || window->transaction.input_origin < window->updates.input_origin))
+               window->updates.input_origin = window->transaction.input_origin;
+
+          worklist_add( LITE_WORKLIST_UPDATES, window );
+          worklist_add( LITE_WORKLIST_EVENTS, window );
+
+          queued = true;
+     }
+
+     window->transaction.num_areas        = 0;
+     window->transaction.requests         = 0;
+     window->transaction.requested_pixels = 0;
+     window->transaction.input_origin     = 0;
+
+     return queued;
 }
 
-DFBResult
-lite_destroy_window_theme( LiteWindowTheme *theme )
+static void
+damage_add( LiteWindow      *window,
+            const DFBRegion *update )
 {
-     LITE_NULL_PARAMETER_CHECK( theme );
+     int        i, j, n;
+     int        budget  = MAX( 1, MIN( lite_config.max_updates, LITE_WINDOW_MAX_UPDATES ) );
+     DFBRegion *regions = window->updates.regions;
+     DFBRegion  region  = *update;
+     DFBRegion  bounding;
+
+     /* merge the new region with every region whose bounding box wastes less than the cost of drawing one more region,
+        this also absorbs contained regions */
+     for (i = 0; i < window->updates.pending; i++) {
+          if (damage_merge_cost( &region, &regions[i], &bounding ) <= LITE_UPDATE_REGION_COST) {
+               D_DEBUG_AT( LiteUpdateDomain, "  -> merging with " DFB_RECT_FORMAT " [%d]\n",
+                           DFB_RECTANGLE_VALS_FROM_REGION( &regions[i] ), i );
 
-     D_DEBUG_AT( LiteWindowDomain, "Destroy window theme: %p\n", theme );
+               region = bounding;
 
-     lite_theme_frame_unload( &theme->frame );
+               regions[i] = regions[--window->updates.pending];
 
-     lite_release_font( theme->title_font );
+               window->updates.stats.merges++;
 
-     D_FREE( theme );
+               /* the grown region may now be worth merging with regions already checked */
+               i = -1;
+          }
+     }
 
-     if (theme == liteDefaultWindowTheme)
-          liteDefaultWindowTheme = NULL;
+     D_DEBUG_AT( LiteUpdateDomain, "  -> adding: " DFB_RECT_FORMAT " [%d]\n",
+                 DFB_RECTANGLE_VALS_FROM_REGION( &region ), window->updates.pending );
 
-     return DFB_OK;
-}
+     regions[window->updates.pending++] = region;
 
-/* internals */
+     /* over budget, merge the pairs wasting the fewest pixels */
+     while (window->updates.pending > budget) {
+          int       best_i    = 0;
+          int       best_j    = 1;
+          long long best_cost = 0;
+          DFBRegion best_bounding;
+
+          n = window->updates.pending;
+
+          for (i = 0; i < n - 1; i++) {
+               for (j = i + 1; j < n; j++) {
+                    long long cost = damage_merge_cost( &regions[i], &regions[j], &bounding );
+
+                    if ((i == 0 && j == 1) || cost < best_cost) {
+                         best_i        = i;
+                         best_j        = j;
+                         best_cost     = cost;
+                         best_bounding = bounding;
+                    }
+               }
+          }
+
+          D_DEBUG_AT( LiteUpdateDomain, "  -> max updates (%d) reached, merging [%d] and [%d] (%lld pixels wasted)\n",
+                      budget, best_i, best_j, best_cost );
+
+          regions[best_i] = best_bounding;
+          regions[best_j] = regions[--window->updates.pending];
+
+          window->updates.stats.merges++;
+     }
+}
 
 static DFBResult
 draw_window( LiteBox         *box,
@@ -2075,6 +3672,7 @@ render_title( LiteWindow *window )
      int               string_width;
      IDirectFBFont    *font;
      IDirectFBSurface *surface;
+     LiteTextLayout    layout;
 
      D_ASSERT( window != NULL );
 
@@ -2102,7 +3700,9 @@ render_title( LiteWindow *window )
 
           surface->SetFont( surface, font );
 
-          font->GetStringWidth( font, window->title, -1, &string_width );
+          lite_measure_text( window->theme->title_font, window->title, -1, LITE_TEXT_WIDTH, &layout );
+
+          string_width = layout.width;
 
           x = window->theme->frame.parts[LITE_THEME_FRAME_PART_LEFT].rect.w;
           if (window->title_x_offset == -1)
@@ -2146,7 +3746,7 @@ render_border( LiteWindow *window )
                                 &window->theme->frame.parts[i].rect, &window->frame_target[i] );
      }
 
-     if (getenv( "LITE_WINDOW_DOUBLEBUFFER" ))
+     if (lite_config.window_doublebuffer)
           surface->Flip( surface, NULL, DSFLIP_BLIT );
 }
 
@@ -2235,7 +3835,13 @@ handle_resize( LiteWindow     *window,
 
      direct_mutex_unlock( &window->updates.lock );
 
-     surface->Flip( surface, NULL, getenv( "LITE_WINDOW_DOUBLEBUFFER" ) ? DSFLIP_BLIT: 0 );
+     surface->Flip( surface, NULL, lite_config.window_doublebuffer ? DSFLIP_BLIT: 0 );
+
+     direct_mutex_lock( &window->updates.lock );
+
+     latency_present( window );
+
+     direct_mutex_unlock( &window->updates.lock );
 
      return 1;
 }
@@ -2257,7 +3863,6 @@ static int
 handle_destroy( LiteWindow *window )
 {
      int ret = DFB_OK;
-     int n;
 
      D_ASSERT( window != NULL );
 
@@ -2270,37 +3875,63 @@ handle_destroy( LiteWindow *window )
      if (window->OnDestroy)
           ret = window->OnDestroy( window );
 
-     if (window->window) {
-          event_buffer_global->WaitForEvent( event_buffer_global );
+     if (!unregister_window( window ))
+          D_DEBUG_AT( LiteWindowDomain, "  -> window not found\n" );
 
-          window->window->DetachEventBuffer( window->window, event_buffer_global );
+     worklist_remove( LITE_WORKLIST_EVENTS, window );
+     worklist_remove( LITE_WORKLIST_UPDATES, window );
 
-          event_buffer_global->Release( event_buffer_global );
+     drop_events( window );
 
-          window->window->Release( window->window );
-          window->window = NULL;
-     }
+     /* release the DirectFB resources from the event loop, without waiting for any event */
+     window->cleanup_next = cleanup_list;
+     cleanup_list         = window;
 
-     for (n = 0; n < num_windows_global; n++)
-          if (window_array_global[n] == window)
-               break;
+     return ret;
+}
 
-     if (n == num_windows_global) {
-          D_DEBUG_AT( LiteWindowDomain, "  -> window not found\n" );
-          D_FREE( window );
-          return ret;
+static void
+drop_events( LiteWindow *window )
+{
+     int i, n;
+
+     /* remove the events of the window taken from the buffer but not yet dispatched */
+     for (i = n = event_batch_next; i < event_batch_count; i++) {
+          if (event_batch[i].clazz == DFEC_WINDOW && event_batch[i].window.window_id == window->id) {
+               D_DEBUG_AT( LiteWindowDomain, "  -> dropping event 0x%08x\n", event_batch[i].window.type );
+               continue;
+          }
+
+          event_batch[n++] = event_batch[i];
      }
 
-     num_windows_global--;
+     event_batch_count = n;
+}
+
+static void
+cleanup_windows()
+{
+     while (cleanup_list) {
+          LiteWindow *window = cleanup_list;
 
-     for (; n < num_windows_global; n++)
-          window_array_global[n] = window_array_global[n+1];
+          D_DEBUG_AT( LiteWindowDomain, "%s( %p )\n", __FUNCTION__, window );
 
-     window_array_global = D_REALLOC( window_array_global, num_windows_global * sizeof(LiteWindow*) );
+          cleanup_list = window->cleanup_next;
 
-     D_FREE( window );
+          if (window->window) {
+               window->window->DetachEventBuffer( window->window, event_buffer_global );
 
-     return ret;
+               event_buffer_global->Release( event_buffer_global );
+
+               window->window->Release( window->window );
+               window->window = NULL;
+          }
+
+          if (window->latency.buckets)
+               D_FREE( window->latency.buckets );
+
+          D_FREE( window );
+     }
 }
 
 static int
@@ -2633,10 +4264,12 @@ handle_button( LiteWindow     *window,
                          }
                          else if (ev->y < box->rect.y && diff < 400000) {
                               int            string_width;
-                              IDirectFBFont *font;
+                              LiteTextLayout layout;
 
-                              lite_font( window->theme->title_font, &font );
-                              font->GetStringWidth( font, window->title, -1, &string_width );
+                              lite_measure_text( window->theme->title_font, window->title, -1, LITE_TEXT_WIDTH,
+                                                 &layout );
+
+                              string_width = layout.width;
 
                               /* title double click */
                               if (ev->x > (window->width - string_width) / 2 &&
@@ -2768,6 +4401,126 @@ handle_wheel( LiteWindow     *window,
      return 0;
 }
 
+/* event dispatch table handlers */
+
+static int
+dispatch_size( LiteWindow     *window,
+               DFBWindowEvent *ev )
+{
+     window->last_resize = *ev;
+     worklist_add( LITE_WORKLIST_EVENTS, window );
+
+     return 0;
+}
+
+static int
+dispatch_position_size( LiteWindow     *window,
+                        DFBWindowEvent *ev )
+{
+     int result = handle_move( window, ev );
+
+     if (window->flags & LITE_WINDOW_CONFIGURED) {
+          window->last_resize = *ev;
+          worklist_add( LITE_WORKLIST_EVENTS, window );
+     }
+     else
+          window->flags |= LITE_WINDOW_CONFIGURED;
+
+     return result;
+}
+
+static int
+dispatch_close( LiteWindow     *window,
+                DFBWindowEvent *ev )
+{
+     return handle_close( window );
+}
+
+static int
+dispatch_got_focus( LiteWindow     *window,
+                    DFBWindowEvent *ev )
+{
+     return handle_got_focus( window );
+}
+
+static int
+dispatch_lost_focus( LiteWindow     *window,
+                     DFBWindowEvent *ev )
+{
+     return handle_lost_focus( window );
+}
+
+static int
+dispatch_enter( LiteWindow     *window,
+                DFBWindowEvent *ev )
+{
+     window->last_motion = *ev;
+     worklist_add( LITE_WORKLIST_EVENTS, window );
+
+     return handle_enter( window, ev );
+}
+
+static int
+dispatch_motion( LiteWindow     *window,
+                 DFBWindowEvent *ev )
+{
+     window->last_motion = *ev;
+     worklist_add( LITE_WORKLIST_EVENTS, window );
+
+     if (window->mouse_func)
+          window->mouse_func( ev, window->mouse_data );
+
+     return 0;
+}
+
+static int
+dispatch_button( LiteWindow     *window,
+                 DFBWindowEvent *ev )
+{
+     int result = handle_button( window, ev );
+
+     if (window->mouse_func && !(window->flags & LITE_WINDOW_DESTROYED))
+          window->mouse_func( ev, window->mouse_data );
+
+     return result;
+}
+
+static int
+dispatch_key_up( LiteWindow     *window,
+                 DFBWindowEvent *ev )
+{
+     int result = handle_key_up( window, ev );
+
+     if (window->keyboard_func && !(window->flags & LITE_WINDOW_DESTROYED))
+          window->keyboard_func( ev, window->keyboard_data );
+
+     return result;
+}
+
+static int
+dispatch_key_down( LiteWindow     *window,
+                   DFBWindowEvent *ev )
+{
+     int result = handle_key_down( window, ev );
+
+     if (window->keyboard_func && !(window->flags & LITE_WINDOW_DESTROYED))
+          window->keyboard_func( ev, window->keyboard_data );
+
+     return result;
+}
+
+static int
+dispatch_wheel( LiteWindow     *window,
+                DFBWindowEvent *ev )
+{
+     int result = handle_wheel( window, ev );
+
+     if (window->wheel_func && !(window->flags & LITE_WINDOW_DESTROYED))
+          window->wheel_func( ev, window->wheel_data );
+
+     return result;
+}
+
 DFBResult
 prvlite_release_window_resources()
 {
@@ -2797,24 +4550,89 @@ prvlite_release_window_resources()
           }
      }
 
+     cleanup_windows();
+
      if (event_buffer_global) {
           event_buffer_global->Release( event_buffer_global );
           event_buffer_global = NULL;
      }
 
-     LiteWindowTimeout *timeout_node = timeout_queue;
-     while (timeout_node) {
-         LiteWindowTimeout *next = timeout_node->next;
-         D_FREE( timeout_node );
-         timeout_node = next;
+     if (window_array_global && !num_windows_global) {
+          D_FREE( window_array_global );
+
+          window_array_global = NULL;
+          max_windows_global  = 0;
+     }
+
+     if (window_ids_global && !num_windows_global) {
+          direct_hash_destroy( window_ids_global );
+
+          window_ids_global = NULL;
+     }
+
+     if (!num_windows_global)
+          memset( worklists, 0, sizeof(worklists) );
+
+     event_batch_count = 0;
+     event_batch_next  = 0;
+
+     if (record_active)
+          lite_record_events( NULL );
+
+     if (replay_active)
+          replay_finish();
+
+     if (!num_windows_global)
+          window_serial_next = 0;
+
+     /* drop tasks that were never run */
+     while (task_queue) {
+          LiteWindowTask *next = task_queue->next;
+          D_FREE( task_queue );
+          task_queue = next;
+     }
+
+     while (task_stack) {
+          LiteWindowTask *next = task_stack->next;
+          D_FREE( task_stack );
+          task_stack = next;
+     }
+
+     LiteTimeoutChunk *timeout_chunk = timeout_chunks;
+     while (timeout_chunk) {
+         LiteTimeoutChunk *next = timeout_chunk->next;
+         D_FREE( timeout_chunk );
+         timeout_chunk = next;
      }
 
-     LiteWindowIdle *idle_node = idle_queue;
-     while (idle_node) {
-         LiteWindowIdle *next = idle_node->next;
-         D_FREE( idle_node );
-         idle_node = next;
+     if (timeout_heap)
+          D_FREE( timeout_heap );
+
+     if (timeout_ids)
+          direct_hash_destroy( timeout_ids );
+
+     timeout_heap     = NULL;
+     timeout_count    = 0;
+     timeout_capacity = 0;
+     timeout_ids      = NULL;
+     timeout_free     = NULL;
+     timeout_chunks   = NULL;
+
+     LiteIdleChunk *idle_chunk = idle_chunks;
+     while (idle_chunk) {
+         LiteIdleChunk *next = idle_chunk->next;
+         D_FREE( idle_chunk );
+         idle_chunk = next;
      }
 
+     if (idle_ids)
+          direct_hash_destroy( idle_ids );
+
+     idle_queue  = NULL;
+     idle_tail   = NULL;
+     idle_ids    = NULL;
+     idle_free   = NULL;
+     idle_chunks = NULL;
+
      return DFB_OK;
 }
@@ -32,8 +32,11 @@ extern "C" {
 #include <lite/font.h>
 #include <lite/theme.h>
 
-/** @brief Maximum number of update areas. */
-#define LITE_WINDOW_MAX_UPDATES 4
+/** @brief Maximum number of update areas, the actual budget is set by the max-updates runtime option. */
+#define LITE_WINDOW_MAX_UPDATES 16
+
+/** @brief Number of entries of the window event dispatch tables, one per DFBWindowEventType bit. */
+#define LITE_WINDOW_EVENT_TYPES 32
 
 /** @brief Macro to convert a generic LiteBox into a LiteWindow. */
 #define LITE_WINDOW(l) ((LiteWindow*) (l))
@@ -94,6 +97,44 @@ typedef struct {
 /** @brief Default window theme. */
 extern LiteWindowTheme *liteDefaultWindowTheme;
 
+/** @brief Window update statistics. */
+typedef struct {
+     unsigned long long             requested_pixels;     /**< Pixels requested by lite_update_window() */
+     unsigned long long             drawn_pixels;         /**< Pixels actually redrawn */
+     unsigned int                   requests;             /**< Number of queued update requests */
+     unsigned int                   regions;              /**< Number of regions redrawn */
+     unsigned int                   merges;               /**< Number of region merges */
+     unsigned long long             culled_pixels;        /**< Pixels not painted because opaque children cover them */
+     unsigned int                   culled_boxes;         /**< Boxes not drawn because opaque siblings cover them */
+     unsigned int                   skipped_draws;        /**< Draw() calls skipped beneath the opaque box of a dirty area */
+     unsigned int                   batched_requests;     /**< Update requests collected by lite_begin_update() transactions */
+     unsigned int                   commits;              /**< Number of batches of collected updates submitted */
+} LiteWindowUpdateStats;
+
+/** @brief Frame clock statistics. */
+typedef struct {
+     unsigned int                   frames;               /**< Number of frames drawn */
+     unsigned int                   missed_frames;        /**< Number of frame periods missed by late or slow frames */
+     long long                      last_frame_time;      /**< Duration of the last frame (microseconds) */
+     long long                      max_frame_time;       /**< Longest frame duration (microseconds) */
+     long long                      total_frame_time;     /**< Sum of all frame durations (microseconds) */
+} LiteFrameStats;
+
+/** @brief Maximum number of dirty areas tracked per window before drawing all pending updates completely. */
+#define LITE_WINDOW_MAX_DIRTY 16
+
+/** @brief Number of buckets of the latency histograms, with 16 buckets per power of two up to 2^31 microseconds. */
+#define LITE_LATENCY_BUCKETS 448
+
+/** @brief Input to present latency statistics (microseconds). */
+typedef struct {
+     unsigned int                   count;                /**< Number of samples */
+     long long                      p50;                  /**< Median latency */
+     long long                      p95;                  /**< 95th percentile latency */
+     long long                      p99;                  /**< 99th percentile latency */
+     long long                      max;                  /**< Maximum latency */
+} LiteLatencyStats;
+
 /** @brief Window event callback. */
 typedef DFBResult (*LiteWindowEventFunc)( DFBWindowEvent* evt, void *data );
 
@@ -113,6 +154,7 @@ typedef struct _LiteWindow {
      int                            height;               /**< Window height */
      u8                             opacity;              /**< Window opacity */
      DFBWindowID                    id;                   /**< Window ID */
+     unsigned int                   serial;               /**< Creation order, matches windows in event recordings */
      char                          *title;                /**< Window title */
      IDirectFBWindow               *window;               /**< Underlying DirectFB window */
      IDirectFBSurface              *surface;              /**< Underlying DirectFB surface */
@@ -153,12 +195,52 @@ typedef struct _LiteWindow {
      LiteWindowEventFunc            wheel_func;           /**< Scroll wheel callback */
      void                          *wheel_data;           /**< Scroll wheel callback data */
 
+     struct {
+          LiteWindowEventFunc       func;
+          void                     *data;
+     } raw_handlers[LITE_WINDOW_EVENT_TYPES];             /**< Raw callbacks indexed by event type bit */
+
      struct {
           DirectMutex               lock;
           int                       pending;
           DFBRegion                 regions[LITE_WINDOW_MAX_UPDATES];
+          LiteWindowUpdateStats     stats;
+          long long                 input_origin;
+          struct {
+               DFBRegion            region;
+               LiteBox             *floor;
+          }                         dirty[LITE_WINDOW_MAX_DIRTY];
+          int                       num_dirty;            /* -1 if the pending updates must be drawn completely */
+          unsigned int              dirty_serial;
      } updates;                                           /**< Update areas */
 
+     struct {
+          int                       depth;
+          struct {
+               DFBRegion            region;
+               LiteBox             *floor;
+          }                         areas[LITE_WINDOW_MAX_DIRTY];
+          int                       num_areas;
+          unsigned int              serial;               /* geometry serial when the first area was collected */
+          unsigned int              requests;
+          unsigned long long        requested_pixels;
+          long long                 input_origin;
+          int                       queued;               /* areas submitted early, the transaction was full */
+     } transaction;                                       /**< Collected by lite_begin_update(), under updates.lock */
+
+     struct {
+          u32                      *buckets;
+          unsigned int              count;
+          long long                 max;
+     } latency;                                           /**< Input to present latency histogram */
+
+     struct {
+          struct _LiteWindow       *next;
+          int                       queued;
+     } worklists[2];                                      /**< Event loop worklists (pending events, pending updates) */
+
+     struct _LiteWindow            *cleanup_next;         /**< Next destroyed window waiting for its resources to be released */
+
      LiteBlendMode                  content_mode;         /**< Content blend mode */
      LiteBlendMode                  opacity_mode;         /**< Opacity blend mode */
 
@@ -216,6 +298,11 @@ typedef struct _LiteWindow {
                                                           LiteBox            *box );
                                                           /**< Box to be Removed callback */
 
+     int                          (*OnBoxesAdded)       ( struct _LiteWindow *self,
+                                                          LiteBox           **boxes,
+                                                          int                 num );
+                                                          /**< Boxes added callback, replaces OnBoxAdded if set */
+
      int                            internal_ref_count;   /**< Event loop reference count */
 
      DFBColor                       title_color;          /**< Title color */
@@ -312,6 +399,78 @@ DFBResult lite_window_set_modal            ( LiteWindow *window,
 DFBResult lite_window_event_loop           ( LiteWindow *window,
                                              int         timeout );
 
+/**
+ * @brief Get input to present latency statistics.
+ *
+ * This function will retrieve the latency percentiles of the
+ * window, measured from the timestamp of an input event to the
+ * flip that shows the updates it caused. Percentiles are
+ * accurate to about 6%.
+ *
+ * @param[in]  window                        Valid LiteWindow object
+ * @param[out] ret_stats                     Latency statistics
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_window_latency          ( LiteWindow       *window,
+                                             LiteLatencyStats *ret_stats );
+
+/**
+ * @brief Reset input to present latency statistics.
+ *
+ * This function will clear the latency histogram of the window.
+ *
+ * @param[in]  window                        Valid LiteWindow object
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_reset_window_latency        ( LiteWindow *window );
+
+/**
+ * @brief Record events.
+ *
+ * This function will start recording all events dispatched by
+ * the window event loop, along with timeout, idle and task
+ * callback firings, to a binary file. Windows are identified
+ * by their creation order. Pass NULL to stop recording.
+ *
+ * @param[in]  filename                      Recording file, or NULL
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_record_events               ( const char *filename );
+
+/**
+ * @brief Replay recorded events.
+ *
+ * This function will feed the input events of a recording made
+ * with lite_record_events() to the window event loop, in place
+ * of live input events. While replaying, the event loop runs on
+ * a virtual clock that jumps to the next recorded event, timeout
+ * or frame instead of waiting, so that a replay is deterministic
+ * and does not depend on the speed of the machine. Frame times
+ * are still measured with the real clock. The event loop returns
+ * DFB_EOF when the recording is exhausted.
+ *
+ * @param[in]  filename                      Recording file
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_replay_events               ( const char *filename );
+
+/**
+ * @brief Get frame clock statistics.
+ *
+ * This function will retrieve the number of frames drawn by
+ * the event loop, the number of missed frames when a target
+ * frame rate is configured, and the frame durations.
+ *
+ * @param[out] ret_stats                     Frame statistics
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_frame_stats             ( LiteFrameStats *ret_stats );
+
 /**
  * @brief Exit the event loop.
  *
@@ -366,6 +525,23 @@ DFBResult lite_enqueue_timeout_callback    ( int              timeout,
  */
 DFBResult lite_remove_timeout_callback     ( int timeout_id );
 
+/**
+ * @brief Post a task to the event loop.
+ *
+ * This function queues a callback that will be called once
+ * from the window event loop. It can be called from any
+ * thread without blocking, tasks are run in posting order
+ * before the next events are dispatched. If the callback
+ * returns an error, the event loop exits with this error.
+ *
+ * @param[in]  callback                      Callback function to call from the event loop
+ * @param[in]  callback_data                 Context data to pass to the callback
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_post_task                   ( LiteTimeoutFunc  callback,
+                                             void            *callback_data );
+
 /**
  * @brief Adjust timeouts for time change.
  *
@@ -423,6 +599,56 @@ DFBResult lite_remove_idle_callback        ( int idle_id );
 DFBResult lite_update_window               ( LiteWindow      *window,
                                              const DFBRegion *region );
 
+/**
+ * @brief Begin a transaction of updates.
+ *
+ * This function will suspend submission of updates for the
+ * window until the matching lite_end_update() call. Updates
+ * requested meanwhile are collected without waking up the event
+ * loop, and are submitted at once by the outermost
+ * lite_end_update(). Transactions can be nested.
+ * If NULL is passed, updates of all windows are collected.
+ *
+ * Updates are collected under the update lock of the window, so
+ * any thread may keep requesting updates during a transaction;
+ * they are collected too and shown when the transaction ends.
+ * Any thread may end a transaction, but the calls must balance.
+ *
+ * @param[in]  window                        Valid LiteWindow object or NULL
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_begin_update                ( LiteWindow      *window );
+
+/**
+ * @brief End a transaction of updates.
+ *
+ * This function will end a transaction begun with
+ * lite_begin_update(). When the outermost transaction ends,
+ * the collected updates are queued for drawing and the event
+ * loop is woken up once.
+ *
+ * @param[in]  window                        Same window as passed to lite_begin_update()
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_end_update                  ( LiteWindow      *window );
+
+/**
+ * @brief Get window update statistics.
+ *
+ * This function will retrieve the number of pixels requested
+ * for update and the number of pixels actually redrawn since
+ * the window was created.
+ *
+ * @param[in]  window                        Valid LiteWindow object
+ * @param[out] ret_stats                     Update statistics
+ *
+ * @return DFB_OK if successful.
+ */
+DFBResult lite_get_window_update_stats     ( LiteWindow            *window,
+                                             LiteWindowUpdateStats *ret_stats );
+
 /**
  * @brief Update all windows.
  *